@@ -0,0 +1,466 @@
+#include "async_client.h"
+
+#include "http.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace ct {
+namespace {
+
+// ответ больше этого - не ответ по схеме
+constexpr std::size_t MAX_HEAD = 1 << 16;
+constexpr std::size_t MAX_BODY = 1 << 26;
+
+// data.u64 для eventfd; у соединений там их номер в conns_
+constexpr uint64_t WAKE = ~uint64_t(0);
+
+std::exception_ptr rpc_error(const std::string& what) {
+  return std::make_exception_ptr(RpcError(what));
+}
+} // namespace
+
+AsyncClient::AsyncClient(AsyncClientOptions opts)
+    : opts_(std::move(opts)) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addrs = nullptr;
+  std::string port = std::to_string(opts_.port);
+  int rc = ::getaddrinfo(opts_.host.c_str(), port.c_str(), &hints, &addrs);
+  if (rc != 0) {
+    throw RpcError("Cannot resolve " + opts_.host + ": " + ::gai_strerror(rc));
+  }
+  std::memcpy(&addr_, addrs->ai_addr, addrs->ai_addrlen);
+  addr_len_ = addrs->ai_addrlen;
+  ::freeaddrinfo(addrs);
+
+  request_head_ = "POST ";
+  if (opts_.path.empty() || opts_.path.front() != '/') {
+    request_head_ += '/';
+  }
+  request_head_ += opts_.path;
+  request_head_ += " HTTP/1.1\r\nHost: " + opts_.host + ":" + port;
+  request_head_ += "\r\nContent-Type: application/octet-stream\r\nContent-Length: ";
+  conns_.resize(opts_.connections == 0 ? 1 : opts_.connections);
+
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || wake_fd_ < 0) {
+    int err = errno;
+    if (epoll_fd_ >= 0) {
+      ::close(epoll_fd_);
+    }
+    throw RpcError(std::string("Cannot start client: ") + std::strerror(err));
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.u64 = WAKE;
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+  thread_ = std::thread([this] { loop(); });
+}
+
+AsyncClient::~AsyncClient() {
+  {
+    std::lock_guard lock(m_);
+    stopping_ = true;
+  }
+  uint64_t one = 1;
+  [[maybe_unused]] auto n = ::write(wake_fd_, &one, sizeof(one));
+  thread_.join();
+  ::close(wake_fd_);
+  ::close(epoll_fd_);
+}
+
+AsyncClient::RequestId AsyncClient::send(
+    std::span<const std::byte> req,
+    Callback done,
+    std::optional<std::chrono::milliseconds> timeout
+) {
+  auto t = timeout.value_or(opts_.timeout);
+  auto deadline = t.count() > 0 ? Clock::now() + t : Clock::time_point::max();
+  RequestId id;
+  bool wake;
+  {
+    std::lock_guard lock(m_);
+    if (stopping_) {
+      throw RpcError("client is stopped");
+    }
+    id = next_id_++;
+    // если очереди не пусты, поток уже разбужен и заберёт этот запрос вместе с остальными
+    wake = submitted_.empty() && cancelled_.empty();
+    submitted_.push_back({id, Response(req.begin(), req.end()), std::move(done), deadline});
+  }
+  if (wake) {
+    uint64_t one = 1;
+    [[maybe_unused]] auto n = ::write(wake_fd_, &one, sizeof(one));
+  }
+  return id;
+}
+
+AsyncClient::Pending
+AsyncClient::send(std::span<const std::byte> req, std::optional<std::chrono::milliseconds> timeout) {
+  auto promise = std::make_shared<std::promise<Response>>();
+  auto future = promise->get_future();
+  RequestId id = send(
+      req,
+      [promise](Response resp, std::exception_ptr err) {
+        if (err) {
+          promise->set_exception(err);
+        } else {
+          promise->set_value(std::move(resp));
+        }
+      },
+      timeout
+  );
+  return {id, std::move(future)};
+}
+
+void AsyncClient::cancel(RequestId id) {
+  bool wake;
+  {
+    std::lock_guard lock(m_);
+    if (stopping_) {
+      return;
+    }
+    wake = submitted_.empty() && cancelled_.empty();
+    cancelled_.push_back(id);
+  }
+  if (wake) {
+    uint64_t one = 1;
+    [[maybe_unused]] auto n = ::write(wake_fd_, &one, sizeof(one));
+  }
+}
+
+void AsyncClient::loop() {
+  epoll_event events[64];
+  for (;;) {
+    if (!take_commands()) {
+      fail_all("client is shutting down");
+      return;
+    }
+    expire(Clock::now());
+    int n = ::epoll_wait(epoll_fd_, events, 64, wait_ms(Clock::now()));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::string reason = std::string("epoll_wait: ") + std::strerror(errno);
+      {
+        std::lock_guard lock(m_);
+        stopping_ = true;
+      }
+      take_commands();
+      fail_all(reason);
+      return;
+    }
+    for (int k = 0; k < n; k++) {
+      if (events[k].data.u64 == WAKE) {
+        uint64_t value;
+        [[maybe_unused]] auto r = ::read(wake_fd_, &value, sizeof(value));
+        continue;
+      }
+      on_event(static_cast<std::size_t>(events[k].data.u64), events[k].events);
+    }
+  }
+}
+
+bool AsyncClient::take_commands() {
+  std::vector<Submitted> submitted;
+  std::vector<RequestId> cancelled;
+  bool stopping;
+  {
+    std::lock_guard lock(m_);
+    submitted.swap(submitted_);
+    cancelled.swap(cancelled_);
+    stopping = stopping_;
+  }
+  if (stopping) {
+    for (auto& req : submitted) {
+      req.done({}, std::make_exception_ptr(RpcCancelled("client is shutting down")));
+    }
+    return false;
+  }
+  for (auto& req : submitted) {
+    assign(std::move(req));
+  }
+  for (RequestId id : cancelled) {
+    complete(id, {}, std::make_exception_ptr(RpcCancelled("request cancelled")));
+  }
+  // все запросы пачки уже дописаны в буферы, так что в каждое соединение они уходят одним send
+  for (auto& conn : conns_) {
+    std::string error;
+    if (conn.fd >= 0 && !conn.connecting && !flush(conn, error)) {
+      close_connection(conn, error);
+    }
+  }
+  return true;
+}
+
+void AsyncClient::assign(Submitted req) {
+  Connection* conn = &conns_[0];
+  for (auto& c : conns_) {
+    if (c.waiting.size() < conn->waiting.size()) {
+      conn = &c;
+    }
+  }
+  inflight_.emplace(req.id, InFlight{std::move(req.done), req.deadline});
+  if (req.deadline != Clock::time_point::max()) {
+    deadlines_.emplace(req.deadline, req.id);
+  }
+  std::string error;
+  if (conn->fd < 0 && !open_connection(*conn, error)) {
+    complete(req.id, {}, rpc_error(error));
+    return;
+  }
+  conn->out += request_head_;
+  conn->out += std::to_string(req.body.size());
+  conn->out += "\r\n\r\n";
+  conn->out.append(reinterpret_cast<const char*>(req.body.data()), req.body.size());
+  conn->waiting.push_back(req.id);
+}
+
+bool AsyncClient::open_connection(Connection& conn, std::string& error) {
+  std::string where = opts_.host + ":" + std::to_string(opts_.port);
+  int fd = ::socket(addr_.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    error = "Cannot connect to " + where + ": " + std::strerror(errno);
+    return false;
+  }
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  int rc = ::connect(fd, reinterpret_cast<const sockaddr*>(&addr_), addr_len_);
+  if (rc < 0 && errno != EINPROGRESS) {
+    error = "Cannot connect to " + where + ": " + std::strerror(errno);
+    ::close(fd);
+    return false;
+  }
+  conn.fd = fd;
+  conn.connecting = rc < 0;
+  conn.want_write = conn.connecting;
+  epoll_event ev{};
+  ev.events = EPOLLIN | EPOLLRDHUP | (conn.connecting ? EPOLLOUT : 0u);
+  ev.data.u64 = static_cast<uint64_t>(&conn - conns_.data());
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    error = "Cannot connect to " + where + ": " + std::strerror(errno);
+    ::close(fd);
+    conn = Connection{};
+    return false;
+  }
+  return true;
+}
+
+void AsyncClient::on_event(std::size_t k, uint32_t events) {
+  Connection& conn = conns_[k];
+  if (conn.fd < 0) {
+    return;
+  }
+  std::string error;
+  bool ok = true;
+  if (conn.connecting) {
+    if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      ::getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0) {
+        ok = false;
+        error = "Cannot connect to " + opts_.host + ":" + std::to_string(opts_.port) + ": " + std::strerror(err);
+      }
+      conn.connecting = false;
+    }
+  } else if (events & EPOLLERR) {
+    ok = false;
+    error = "connection error";
+  }
+  if (ok && !conn.connecting && (events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP))) {
+    ok = on_readable(conn, error);
+  }
+  if (ok && !conn.connecting) {
+    ok = flush(conn, error);
+  }
+  if (!ok) {
+    close_connection(conn, error);
+  }
+}
+
+// в буфере может лежать сразу несколько ответов - разбираем все целиком пришедшие
+bool AsyncClient::on_readable(Connection& conn, std::string& error) {
+  bool eof = false;
+  char buf[1 << 16];
+  for (;;) {
+    ssize_t n = ::recv(conn.fd, buf, sizeof(buf), 0);
+    if (n > 0) {
+      conn.in.append(buf, static_cast<std::size_t>(n));
+      continue;
+    }
+    if (n == 0) {
+      eof = true;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      error = std::strerror(errno);
+      return false;
+    }
+    break;
+  }
+
+  // сначала разбираем всё, что успело прийти, и только потом закрываем: FIN и Connection: close могут прийти в одном
+  // чтении с готовыми ответами
+  std::size_t pos = 0;
+  bool close = false;
+  while (!close) {
+    std::string_view rest = std::string_view(conn.in).substr(pos);
+    std::optional<HttpHead> head;
+    try {
+      head = parse_http_head(rest, MAX_HEAD, MAX_BODY);
+    } catch (const HttpError& e) {
+      error = std::string("malformed response: ") + e.what();
+      return false;
+    }
+    if (!head || rest.size() - head->size < head->content_length) {
+      break;
+    }
+    if (conn.waiting.empty()) {
+      error = "response without a request";
+      return false;
+    }
+    RequestId id = conn.waiting.front();
+    conn.waiting.pop_front();
+    std::string_view body = rest.substr(head->size, head->content_length);
+    pos += head->size + head->content_length;
+    close = head->connection_close.value_or(head->first == "HTTP/1.0");
+    if (head->second == "200") {
+      auto bytes = std::as_bytes(std::span(body.data(), body.size()));
+      complete(id, Response(bytes.begin(), bytes.end()), nullptr);
+    } else {
+      std::string what = "server replied " + std::string(head->second) + " " + std::string(head->third);
+      if (!body.empty()) {
+        what += ": " + std::string(body);
+      }
+      complete(id, {}, rpc_error(what));
+    }
+  }
+  conn.in.erase(0, pos);
+  if (close || eof) {
+    error = "connection closed by server";
+    return false;
+  }
+  return true;
+}
+
+bool AsyncClient::flush(Connection& conn, std::string& error) {
+  while (conn.out_pos < conn.out.size()) {
+    ssize_t n = ::send(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos, MSG_NOSIGNAL);
+    if (n >= 0) {
+      conn.out_pos += static_cast<std::size_t>(n);
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      error = std::strerror(errno);
+      return false;
+    }
+    // сокет переполнен: допишем, когда epoll скажет, что можно
+    watch(conn, true);
+    return true;
+  }
+  conn.out.clear();
+  conn.out_pos = 0;
+  watch(conn, false);
+  return true;
+}
+
+void AsyncClient::watch(Connection& conn, bool write) {
+  if (conn.want_write == write) {
+    return;
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN | EPOLLRDHUP | (write ? EPOLLOUT : 0u);
+  ev.data.u64 = static_cast<uint64_t>(&conn - conns_.data());
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &ev);
+  conn.want_write = write;
+}
+
+// соединение сбрасывается в исходное состояние и откроется заново, когда на него попадёт следующий запрос
+void AsyncClient::close_connection(Connection& conn, const std::string& reason) {
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn.fd, nullptr);
+  ::close(conn.fd);
+  std::deque<RequestId> waiting = std::move(conn.waiting);
+  conn = Connection{};
+  for (RequestId id : waiting) {
+    complete(id, {}, rpc_error(reason));
+  }
+}
+
+// ответ на просроченный запрос, даже отменённый раньше, так и не пришёл: сервер завис на нём, а всё, что отправлено
+// в это соединение следом, стоит в очереди за ним. соединение закрываем, ждущие в нём запросы получают ошибку, а
+// следующий запрос откроет его заново
+void AsyncClient::expire(Clock::time_point now) {
+  while (!deadlines_.empty() && deadlines_.top().first <= now) {
+    RequestId id = deadlines_.top().second;
+    deadlines_.pop();
+    complete(id, {}, std::make_exception_ptr(RpcTimeout("request timed out")));
+    if (Connection* conn = waiting_on(id)) {
+      close_connection(*conn, "connection dropped after a request on it timed out");
+    }
+  }
+}
+
+AsyncClient::Connection* AsyncClient::waiting_on(RequestId id) {
+  for (auto& conn : conns_) {
+    if (std::binary_search(conn.waiting.begin(), conn.waiting.end(), id)) {
+      return &conn;
+    }
+  }
+  return nullptr;
+}
+
+int AsyncClient::wait_ms(Clock::time_point now) {
+  // срок ещё нужен, пока запрос ждёт ответа: либо не завершён, либо отменён, но ответ на него не пришёл
+  while (!deadlines_.empty() && !inflight_.contains(deadlines_.top().second) &&
+         !waiting_on(deadlines_.top().second)) {
+    deadlines_.pop();
+  }
+  if (deadlines_.empty()) {
+    return -1;
+  }
+  auto left = std::chrono::ceil<std::chrono::milliseconds>(deadlines_.top().first - now).count();
+  return left <= 0 ? 0 : left > INT_MAX ? INT_MAX : static_cast<int>(left);
+}
+
+void AsyncClient::complete(RequestId id, Response resp, std::exception_ptr err) {
+  auto it = inflight_.find(id);
+  if (it == inflight_.end()) {
+    return;
+  }
+  Callback done = std::move(it->second.done);
+  inflight_.erase(it);
+  done(std::move(resp), std::move(err));
+}
+
+void AsyncClient::fail_all(const std::string& reason) {
+  for (auto& conn : conns_) {
+    if (conn.fd >= 0) {
+      ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn.fd, nullptr);
+      ::close(conn.fd);
+    }
+    conn = Connection{};
+  }
+  auto inflight = std::move(inflight_);
+  inflight_.clear();
+  for (auto& [id, req] : inflight) {
+    req.done({}, std::make_exception_ptr(RpcCancelled(reason)));
+  }
+}
+} // namespace ct
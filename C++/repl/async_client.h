@@ -0,0 +1,157 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ct {
+
+struct RpcError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+struct RpcTimeout : RpcError {
+  using RpcError::RpcError;
+};
+
+struct RpcCancelled : RpcError {
+  using RpcError::RpcError;
+};
+
+struct AsyncClientOptions {
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  std::string path;
+  // сколько постоянных соединений держать; открываются при первом запросе, который на них попал
+  std::size_t connections = 4;
+  // таймаут запроса по умолчанию, 0 - без таймаута
+  std::chrono::milliseconds timeout{0};
+};
+
+// асинхронный клиент к тому же rpc-серверу, что и rpc::Client (кадрирование как в rpc_server.h). один поток с epoll
+// обслуживает пул постоянных соединений: каждый запрос уходит в соединение, где сейчас меньше всего ждущих ответа,
+// и внутри соединения запросы идут подряд, не дожидаясь ответов (pipelining). так в полёте может быть сколько угодно
+// запросов без потока на каждый.
+// просроченный или отменённый запрос завершается сразу, а его ответ, если всё-таки придёт, выбрасывается. если к
+// сроку запроса (у отменённого - к тому же сроку, что был до отмены) ответа так и нет, соединение закрывается: ждущие
+// в нём запросы получают RpcError, а соединение откроется заново со следующим запросом. отменённый запрос без
+// таймаута ждёт ответа, как и неотменённый
+class AsyncClient {
+public:
+  using Response = std::vector<std::byte>;
+  using RequestId = uint64_t;
+  // ровно один вызов на запрос: либо ответ, либо ошибка (RpcError, RpcTimeout, RpcCancelled) в err.
+  // зовётся из потока клиента, поэтому не должен ни блокироваться, ни бросать
+  using Callback = std::function<void(Response resp, std::exception_ptr err)>;
+
+  struct Pending {
+    RequestId id;
+    std::future<Response> response;
+  };
+
+  // бросает RpcError, если не удалось разрешить адрес или запустить поток
+  explicit AsyncClient(AsyncClientOptions opts);
+  // незавершённые запросы получают RpcCancelled
+  ~AsyncClient();
+
+  AsyncClient(const AsyncClient&) = delete;
+  AsyncClient& operator=(const AsyncClient&) = delete;
+
+  // можно звать из любых потоков. timeout - nullopt значит взять из опций
+  RequestId send(
+      std::span<const std::byte> req,
+      Callback done,
+      std::optional<std::chrono::milliseconds> timeout = std::nullopt
+  );
+  Pending send(std::span<const std::byte> req, std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+  // запрос, который ещё не завершён, завершается с RpcCancelled; уже завершённый не трогаем
+  void cancel(RequestId id);
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Submitted {
+    RequestId id;
+    Response body;
+    Callback done;
+    Clock::time_point deadline;
+  };
+
+  struct InFlight {
+    Callback done;
+    Clock::time_point deadline;
+  };
+
+  struct Connection {
+    int fd = -1;
+    bool connecting = false;
+    // EPOLLOUT подписан: соединение ещё устанавливается или вывод не ушёл целиком
+    bool want_write = false;
+    std::string in;
+    std::string out;
+    std::size_t out_pos = 0;
+    // запросы, отправленные в это соединение, в порядке отправки - в том же порядке придут ответы. id растут, так
+    // что очередь отсортирована. id отменённых и просроченных тоже остаются тут, чтобы не сбить соответствие
+    std::deque<RequestId> waiting;
+  };
+
+  void loop();
+  // забрать под локом всё, что пришло из других потоков; false - пора останавливаться
+  bool take_commands();
+  void assign(Submitted req);
+  bool open_connection(Connection& conn, std::string& error);
+  void on_event(std::size_t k, uint32_t events);
+  // on_readable и flush возвращают false, если соединение надо закрыть; причину пишут в error
+  bool on_readable(Connection& conn, std::string& error);
+  bool flush(Connection& conn, std::string& error);
+  void watch(Connection& conn, bool write);
+  void close_connection(Connection& conn, const std::string& reason);
+  void expire(Clock::time_point now);
+  // соединение, в котором запрос ещё ждёт ответа, или nullptr
+  Connection* waiting_on(RequestId id);
+  int wait_ms(Clock::time_point now);
+  void complete(RequestId id, Response resp, std::exception_ptr err);
+  void fail_all(const std::string& reason);
+
+  AsyncClientOptions opts_;
+  sockaddr_storage addr_{};
+  socklen_t addr_len_ = 0;
+  std::string request_head_;
+  int epoll_fd_ = -1;
+  // eventfd, через который send, cancel и деструктор будят поток
+  int wake_fd_ = -1;
+
+  std::mutex m_;
+  RequestId next_id_ = 1;
+  std::vector<Submitted> submitted_;
+  std::vector<RequestId> cancelled_;
+  bool stopping_ = false;
+
+  // дальше всё трогает только поток клиента
+  std::vector<Connection> conns_;
+  std::unordered_map<RequestId, InFlight> inflight_;
+  // сроки с ленивым удалением: запись, чьего id уже нет в inflight_, просто пропускается
+  std::priority_queue<
+      std::pair<Clock::time_point, RequestId>,
+      std::vector<std::pair<Clock::time_point, RequestId>>,
+      std::greater<>>
+      deadlines_;
+  std::thread thread_;
+};
+
+} // namespace ct
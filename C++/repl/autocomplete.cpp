@@ -4,8 +4,6 @@
 #include "request_parser.h"
 
 #include <cctype>
-#include <map>
-#include <set>
 #include <vector>
 
 namespace ct {
@@ -16,35 +14,36 @@ void skip_spaces(TextView& txt) {
   }
 }
 
-std::optional<std::string> get_func(TextView& txt, const std::vector<std::string>& funcs, std::string& out) {
+const Function* get_func(TextView& txt, const NameIndex<const Function*>& funcs, std::string& out) {
   skip_spaces(txt);
   auto start = txt.it;
   while (!txt.eof() && txt.peek() != '(') {
     txt.advance();
   }
-  std::string token = std::string(txt.sv.substr(start, txt.it - start));
-  for (auto& f : funcs) {
-    if (f.rfind(token, 0) == 0) {
-      out += f.substr(token.size());
-      return f;
-    }
+  std::string_view token = txt.sv.substr(start, txt.it - start);
+  auto [first, last] = funcs.range(token);
+  if (first == last) {
+    return nullptr;
   }
-  return std::nullopt;
+  out += funcs[first].name.substr(token.size());
+  return funcs[first].value;
 }
 
-std::optional<std::string> get_arg(TextView& txt, std::set<std::string>& args, std::string& out) {
+std::optional<uint32_t>
+get_arg(TextView& txt, const NameIndex<uint32_t>& args, std::vector<bool>& used, std::string& out) {
   skip_spaces(txt);
   auto start = txt.it;
   while (!txt.eof() && txt.peek() != '=') {
     txt.advance();
   }
-  std::string token = std::string(txt.sv.substr(start, txt.it - start));
-  for (auto it = args.begin(); it != args.end(); ++it) {
-    if (it->rfind(token, 0) == 0) {
-      out += it->substr(token.size());
-      std::string chosen = *it;
-      args.erase(it);
-      return chosen;
+  std::string_view token = txt.sv.substr(start, txt.it - start);
+  auto [first, last] = args.range(token);
+  for (std::size_t k = first; k < last; k++) {
+    uint32_t pos = args[k].value;
+    if (!used[pos]) {
+      used[pos] = true;
+      out += args[k].name.substr(token.size());
+      return pos;
     }
   }
   return std::nullopt;
@@ -67,10 +66,8 @@ bool append_if_missing(TextView& txt, char ch, std::string& out) {
   return false;
 }
 
-ParseStruct fill_structure(std::string& out, std::string_view type, TextView& txt, const Schema& sch);
-
-ParseStruct fill_primitive(std::string_view type, TextView& txt, std::string& out, const Schema& sch) {
-  if (type == "string") {
+ParseStruct fill_primitive(Builtin b, TextView& txt, std::string& out) {
+  if (b == Builtin::String) {
     if (append_if_missing(txt, '\"', out)) {
       collect_until_any(txt, "\"");
       if (!txt.eof()) {
@@ -81,24 +78,16 @@ ParseStruct fill_primitive(std::string_view type, TextView& txt, std::string& ou
     }
     return ParseStruct::Incomplete;
   }
-  std::set<std::string> primitives;
-  primitives.insert("int32");
-  primitives.insert("uint32");
-  primitives.insert("int64");
-  primitives.insert("uint64");
-  if (primitives.find(std::string(type)) != primitives.end()) {
-    auto before = txt.it;
-    collect_until_any(txt, "}),");
-    return (!txt.eof() && txt.it != before) ? ParseStruct::Finished : ParseStruct::Incomplete;
-  }
-  return fill_structure(out, type, txt, sch);
+  auto before = txt.it;
+  collect_until_any(txt, "}),");
+  return (!txt.eof() && txt.it != before) ? ParseStruct::Finished : ParseStruct::Incomplete;
 }
 
-ParseStruct fill_structure(std::string& out, std::string_view type, TextView& txt, const Schema& sch) {
+void open_structure(const Struct& st, TextView& txt, std::string& out) {
   if (!txt.eof() && txt.peek() != '{') {
     std::string prefix = collect_until_any(txt, "{");
-    if (type.rfind(prefix, 0) == 0) {
-      out += type.substr(prefix.size());
+    if (st.name.rfind(prefix, 0) == 0) {
+      out += st.name.substr(prefix.size());
     }
     append_if_missing(txt, '{', out);
   } else if (txt.eof()) {
@@ -106,87 +95,123 @@ ParseStruct fill_structure(std::string& out, std::string_view type, TextView& tx
   } else {
     txt.advance();
   }
+}
 
-  const Struct* st = sch.find_struct(type);
-  if (st->fields.empty()) {
-    append_if_missing(txt, '}', out);
-    return ParseStruct::Finished;
-  }
+namespace {
 
-  std::set<std::string> remaining;
-  std::map<std::string, std::string> mapping;
-  for (auto& f : st->fields) {
-    remaining.insert(f.name);
-    mapping[f.name] = f.type.str();
-  }
-  while (!remaining.empty()) {
-    auto chosen = *get_arg(txt, remaining, out);
-    append_if_missing(txt, '=', out);
-    ParseStruct stt = fill_primitive(mapping[chosen], txt, out, sch);
-    if (stt == ParseStruct::Finished) {
-      if (remaining.empty()) {
-        append_if_missing(txt, '}', out);
-        return ParseStruct::Finished;
-      } else {
-        append_if_missing(txt, ',', out);
-        append_if_missing(txt, ' ', out);
-        continue;
-      }
-    }
-    if (txt.eof()) {
-      break;
-    }
-  }
-  return ParseStruct::Incomplete;
+CompletionFrame frame_of(const Function& fn) {
+  return CompletionFrame{&fn, nullptr, std::vector<bool>(fn.args.size()), fn.args.size()};
 }
 
-void parse_function(std::string& out, std::string_view fnName, TextView& txt, const Schema& sch) {
-  append_if_missing(txt, '(', out);
+CompletionFrame frame_of(const Struct& st) {
+  return CompletionFrame{nullptr, &st, std::vector<bool>(st.fields.size()), st.fields.size()};
+}
+} // namespace
 
-  const Function* fn = sch.find_function(fnName);
-  if (fn->args.empty()) {
-    append_if_missing(txt, ')', out);
-    return;
+std::string Completer::complete(std::string_view input) {
+  std::size_t common = 0;
+  while (common < input.size() && common < input_.size() && input[common] == input_[common]) {
+    common++;
+  }
+  while (!checkpoints_.empty() && checkpoints_.back().pos >= common) {
+    checkpoints_.pop_back();
   }
 
-  std::set<std::string> remaining;
-  std::map<std::string, std::string> mapping;
-  for (auto& f : fn->args) {
-    remaining.insert(f.name);
-    mapping[f.name] = f.type.str();
+  TextView txt(input);
+  std::string out;
+  std::vector<CompletionFrame> stack;
+  if (!checkpoints_.empty()) {
+    // run сразу же снимет этот снимок заново
+    CompletionCheckpoint cp = std::move(checkpoints_.back());
+    checkpoints_.pop_back();
+    txt.it = cp.pos;
+    out = suffix_.substr(0, cp.out_size);
+    stack = std::move(cp.stack);
+  } else if (const Function* fn = get_func(txt, sch_.function_names, out)) {
+    append_if_missing(txt, '(', out);
+    if (fn->args.empty()) {
+      append_if_missing(txt, ')', out);
+    } else {
+      stack.push_back(frame_of(*fn));
+    }
   }
-  while (!remaining.empty()) {
-    std::string chosen = *get_arg(txt, remaining, out);
-    append_if_missing(txt, '=', out);
-    ParseStruct stt = fill_primitive(mapping[chosen], txt, out, sch);
-    if (stt == ParseStruct::Finished) {
-      if (remaining.empty()) {
-        append_if_missing(txt, ')', out);
-        return;
+  run(txt, out, stack);
+
+  input_ = input;
+  suffix_ = out;
+  return input_ + suffix_;
+}
+
+// открытая структура - новый кадр на стеке, а её результат (Finished/Incomplete) кадр родителя обрабатывает так же,
+// как результат примитива
+void Completer::run(TextView& txt, std::string& out, std::vector<CompletionFrame>& stack) {
+  while (!stack.empty()) {
+    checkpoints_.push_back({txt.it, out.size(), stack});
+    CompletionFrame& fr = stack.back();
+    auto chosen = get_arg(txt, fr.fn ? fr.fn->arg_names : fr.st->field_names, fr.used, out);
+    ParseStruct stt = ParseStruct::Incomplete;
+    if (!chosen) {
+      stack.pop_back();
+    } else {
+      fr.left--;
+      append_if_missing(txt, '=', out);
+      Type t = fr.fn ? fr.fn->args[*chosen].type : fr.st->fields[*chosen].type;
+      if (t.is_builtin()) {
+        stt = fill_primitive(t.builtin(), txt, out);
       } else {
+        const Struct& st = *sch_.find_struct(t);
+        open_structure(st, txt, out);
+        if (!st.fields.empty()) {
+          stack.push_back(frame_of(st));
+          continue;
+        }
+        append_if_missing(txt, '}', out);
+        stt = ParseStruct::Finished;
+      }
+    }
+
+    while (!stack.empty()) {
+      CompletionFrame& top = stack.back();
+      if (stt == ParseStruct::Finished) {
+        if (top.left == 0) {
+          append_if_missing(txt, top.fn ? ')' : '}', out);
+          stack.pop_back();
+          continue;
+        }
         append_if_missing(txt, ',', out);
         append_if_missing(txt, ' ', out);
-        continue;
+        break;
+      }
+      if (txt.eof()) {
+        return;
       }
-    }
-    if (txt.eof()) {
       break;
     }
   }
 }
 
 std::string autocomplete(std::string_view input, const Schema& sch) {
-  TextView txt(input);
-  std::string suffix;
-  std::vector<std::string> funcs;
-  for (auto& [name, _] : sch.functions) {
-    funcs.push_back(name);
+  Completer c(sch);
+  return c.complete(input);
+}
+
+void build_completion_index(Schema& sch) {
+  for (auto& [_, st] : sch.structs) {
+    std::vector<NameIndex<uint32_t>::Entry> fields;
+    for (std::size_t k = 0; k < st.fields.size(); k++) {
+      fields.push_back({st.fields[k].name, static_cast<uint32_t>(k)});
+    }
+    st.field_names.build(std::move(fields));
   }
-  auto fnName = get_func(txt, funcs, suffix);
-  if (!fnName) {
-    return std::string(input);
+  std::vector<NameIndex<const Function*>::Entry> funcs;
+  for (auto& [name, fn] : sch.functions) {
+    std::vector<NameIndex<uint32_t>::Entry> args;
+    for (std::size_t k = 0; k < fn.args.size(); k++) {
+      args.push_back({fn.args[k].name, static_cast<uint32_t>(k)});
+    }
+    fn.arg_names.build(std::move(args));
+    funcs.push_back({name, &fn});
   }
-  parse_function(suffix, *fnName, txt, sch);
-  return std::string(input) + suffix;
+  sch.function_names.build(std::move(funcs));
 }
 } // namespace ct
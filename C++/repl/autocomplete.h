@@ -1,6 +1,7 @@
 #include "my_types.h"
 
-#include <set>
+#include <optional>
+#include <string>
 #include <vector>
 
 namespace ct {
@@ -36,31 +37,72 @@ struct TextView {
 
 void skip_spaces(TextView& txt);
 
-std::string collect_until_any(TextView& txt, const std::set<char>& stops);
+std::string collect_until_any(TextView& txt, std::string_view stops);
 
 // в строке out  нас лежит наше дополнение
 // функцией getfunc идём до '(', собирая имя функции. Если не было '(', то дополняем имя функции
-std::optional<std::string> get_func(TextView& txt, const std::vector<std::string>& funcs, std::string& out);
+// из подходящих по префиксу берём первое по алфавиту
+const Function* get_func(TextView& txt, const NameIndex<const Function*>& funcs, std::string& out);
 
 // функцией getarg делаем что-то похожее, но идём до знака =
 // в целом их можно объединить, но в целях читабельности и понятности сделал их разными
-std::optional<std::string> get_arg(TextView& txt, std::set<std::string>& funcs, std::string& out);
+// возвращает позицию выбранного аргумента (поля) и помечает его в used, чтобы второй раз не предлагать
+std::optional<uint32_t>
+get_arg(TextView& txt, const NameIndex<uint32_t>& args, std::vector<bool>& used, std::string& out);
 
 // либо дополняем символом, который щас должен быть, либо переходим к следующему символу
 bool append_if_missing(TextView& t, char ch, std::string& s);
 
-// у parse-struct инвариант такой: начинаем её парсить, когда мы на первом символе после = (которое до структуры)
-// и выходим из этой функции, когда указатель будет на следующем за закрывающей для этой структуры '}'
-// тем самым в этой функции корректно распарситя/дополнится только эта структура и ничего лишнего.
-// возвращаемый тип тут означает, закончилась ли эта структура/дополнили ли мы её до конца, чтобы ожидали
-// или дополнили запятой или закрывающей скобкой
-ParseStruct fill_structure(std::string& out, std::string_view type, TextView& txt, const Schema& sch);
-
 // если у нас число, то по умолчанию считаю, что оно не закончено
-ParseStruct fill_primitive(std::string_view type, TextView& txt, std::string& out, const Schema& sch);
+ParseStruct fill_primitive(Builtin b, TextView& txt, std::string& out);
+
+// начало литерала структуры сразу после '=': дополняем имя структуры и открывающую '{'
+void open_structure(const Struct& st, TextView& txt, std::string& out);
+
+// функция или структура, внутри которой сейчас дополняем. задана ровно одна из fn и st
+struct CompletionFrame {
+  const Function* fn = nullptr;
+  const Struct* st = nullptr;
+  // уже выбранные аргументы (поля) по их позиции
+  std::vector<bool> used;
+  // сколько ещё не выбрано
+  std::size_t left = 0;
+};
+
+// состояние разбора перед очередным аргументом или полем. до этого момента разбор смотрел только на символы
+// input[0..pos], так что для ввода, совпадающего с прошлым хотя бы до pos включительно, с этого места можно продолжить
+struct CompletionCheckpoint {
+  std::size_t pos = 0;
+  // сколько дополнения уже набралось к этому моменту
+  std::size_t out_size = 0;
+  std::vector<CompletionFrame> stack;
+};
 
-// аналогично parse_struct
-void parse_function(std::string& s, std::string_view fnName, TextView& text, const Schema& sch);
+// автодополнение с памятью между нажатиями TAB. разбор идёт по явному стеку CompletionFrame (вложенные структуры
+// не через рекурсию), и перед каждым аргументом или полем сохраняется снимок. при следующем вызове берём последний
+// снимок внутри общего с прошлым вводом префикса и разбираем только хвост, так что работа пропорциональна правке,
+// а не длине строки. схема должна жить дольше Completer
+class Completer {
+public:
+  explicit Completer(const Schema& sch)
+      : sch_(sch) {}
+
+  // input + дополнение
+  std::string complete(std::string_view input);
+
+private:
+  void run(TextView& txt, std::string& out, std::vector<CompletionFrame>& stack);
+
+  const Schema& sch_;
+  std::string input_;
+  std::string suffix_;
+  std::vector<CompletionCheckpoint> checkpoints_;
+};
 
+// разовое дополнение без памяти
 std::string autocomplete(std::string_view input, const Schema& sch);
+
+// строит индексы имён (Schema::function_names, Struct::field_names, Function::arg_names), по которым работает
+// автодополнение. вызывается один раз при загрузке схемы; индексы ссылаются на имена внутри sch
+void build_completion_index(Schema& sch);
 } // namespace ct
@@ -0,0 +1,376 @@
+// воспроизведение записанного файла строк запросов через настоящий клиент и локальную заглушку сервера (rpc_server.h),
+// поднятую в этом же процессе на loopback: ответы даёт автоответчик HandlerRegistry по плану возвращаемого типа, а с
+// --canned на каждую функцию один раз генерируется ответ, и сервер отдаёт его как есть, не тратя время на генерацию.
+// --mode выбирает, как идут запросы:
+//   stages    - построчно, как run_no_tty, но со временем каждой стадии: кодирование (--encode), send через
+//               rpc::Client, decode (deserialize_response) и total - все три вместе. --threads N потоков, у каждого
+//               своё соединение. печатаются p50/p99/p999 стадий и пропускная способность
+//   serial    - run_no_tty
+//   pipelined - run_no_tty_pipelined, --inflight N
+//   staged    - run_no_tty_staged, --workers N и --inflight N
+//   async     - run_no_tty_async, --connections N и --inflight N
+// в режимах repl строки подаются им на вход как есть (файл повторяется --repeat раз), вывод уходит в /dev/null, а
+// печатается только пропускная способность: стадии там идут в разных потоках и порознь не меряются.
+// --encode выбирает путь кодирования в режиме stages: direct - строка сразу в байты (encode_request), как в no-tty;
+// parse - RequestParser и serialize_call_into. сервер делит с клиентом процессор, это надо помнить, сравнивая цифры.
+//   ./replay_bench <schema> <requests> [--mode M] [--encode direct|parse] [--threads N] [--inflight N] [--workers N]
+//                  [--connections N] [--repeat R] [--canned] [--min-str A] [--max-str B]
+// собирается вместе с исходниками repl, кроме файла с main
+#include "../deserializer.h"
+#include "../direct_encoder.h"
+#include "../latency_histogram.h"
+#include "../repl.h"
+#include "../request_parser.h"
+#include "../rpc_server.h"
+#include "../schema_loader.h"
+#include "../serializer.h"
+#include "../staged_pipeline.h"
+#include "../value_gen.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Mode { Stages, Serial, Pipelined, Staged, Async };
+
+struct BenchOptions {
+  std::string schema_path;
+  std::string requests_path;
+  Mode mode = Mode::Stages;
+  // кодирование в режиме stages: true - encode_request, false - RequestParser и serialize_call_into
+  bool direct = true;
+  std::size_t threads = 1;
+  std::size_t inflight = 1;
+  std::size_t workers = 1;
+  std::size_t connections = 1;
+  std::size_t repeat = 1;
+  // отдавать на каждую функцию один заранее сгенерированный ответ
+  bool canned = false;
+  ct::GenOptions gen;
+};
+
+struct Stages {
+  // только выбранного пути: parse и serialize при --encode parse, encode при --encode direct
+  ct::LatencyHistogram parse;
+  ct::LatencyHistogram serialize;
+  ct::LatencyHistogram encode;
+  ct::LatencyHistogram send;
+  ct::LatencyHistogram decode;
+  ct::LatencyHistogram total;
+  uint64_t errors = 0;
+
+  void merge(const Stages& o) {
+    parse.merge(o.parse);
+    serialize.merge(o.serialize);
+    encode.merge(o.encode);
+    send.merge(o.send);
+    decode.merge(o.decode);
+    total.merge(o.total);
+    errors += o.errors;
+  }
+};
+
+uint64_t since(Clock::time_point start) {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+void replay(
+    const ct::Schema& sch,
+    const std::vector<std::string>& lines,
+    const BenchOptions& opts,
+    const ct::Options& rpc,
+    Stages& st
+) {
+  ct::rpc::Client client(rpc.rpc_host, rpc.rpc_port, rpc.rpc_path);
+  ct::RequestArena arena;
+  std::vector<std::byte> req;
+  ct::OutputBuffer out;
+  for (std::size_t r = 0; r < opts.repeat; r++) {
+    for (auto& line : lines) {
+      auto start = Clock::now();
+      try {
+        const ct::Function* fn;
+        auto t = Clock::now();
+        if (opts.direct) {
+          fn = &ct::encode_request(sch, line, req);
+          st.encode.record(since(t));
+        } else {
+          arena.reset();
+          auto call = ct::RequestParser::parse(sch, line, arena.resource());
+          st.parse.record(since(t));
+
+          t = Clock::now();
+          ct::serialize_call_into(sch, call, req, arena.resource());
+          fn = sch.find_function(call.func_name);
+          st.serialize.record(since(t));
+        }
+
+        t = Clock::now();
+        auto resp = client.send(req);
+        st.send.record(since(t));
+
+        t = Clock::now();
+        out.clear();
+        ct::deserialize_response(*fn, resp, out);
+        st.decode.record(since(t));
+      } catch (const std::runtime_error&) {
+        st.errors++;
+        continue;
+      }
+      st.total.record(since(start));
+    }
+  }
+}
+
+void run_stages(
+    const ct::Schema& sch,
+    const std::vector<std::string>& lines,
+    const BenchOptions& opts,
+    const ct::Options& rpc
+) {
+  std::vector<Stages> per_thread(opts.threads);
+  auto start = Clock::now();
+  {
+    std::vector<std::jthread> threads;
+    for (std::size_t k = 0; k < opts.threads; k++) {
+      threads.emplace_back([&, k] { replay(sch, lines, opts, rpc, per_thread[k]); });
+    }
+  }
+  double seconds = static_cast<double>(since(start)) / 1e9;
+
+  Stages all;
+  for (auto& st : per_thread) {
+    all.merge(st);
+  }
+  uint64_t handled = all.total.count() + all.errors;
+  std::printf(
+      "mode=stages encode=%s lines=%llu errors=%llu threads=%zu wall=%.3fs throughput=%.0f lines/s\n",
+      opts.direct ? "direct" : "parse",
+      static_cast<unsigned long long>(handled),
+      static_cast<unsigned long long>(all.errors),
+      opts.threads,
+      seconds,
+      static_cast<double>(handled) / seconds
+  );
+  std::fflush(stdout);
+  if (opts.direct) {
+    all.encode.print(std::cout, "encode   ");
+  } else {
+    all.parse.print(std::cout, "parse    ");
+    all.serialize.print(std::cout, "serialize");
+  }
+  all.send.print(std::cout, "send     ");
+  all.decode.print(std::cout, "decode   ");
+  all.total.print(std::cout, "total    ");
+}
+
+// режим repl целиком: строки идут ему через std::cin, вывод - в /dev/null через std::cout
+void run_repl_mode(
+    const ct::SchemaHandle& handle,
+    const std::vector<std::string>& lines,
+    const BenchOptions& opts,
+    const ct::Options& rpc,
+    const char* name
+) {
+  std::stringstream input;
+  for (std::size_t r = 0; r < opts.repeat; r++) {
+    for (auto& line : lines) {
+      input << line << '\n';
+    }
+  }
+  std::ofstream sink("/dev/null");
+  std::streambuf* cin_buf = std::cin.rdbuf(input.rdbuf());
+  std::streambuf* cout_buf = std::cout.rdbuf(sink.rdbuf());
+  auto start = Clock::now();
+  switch (opts.mode) {
+  case Mode::Serial: {
+    ct::rpc::Client client(rpc.rpc_host, rpc.rpc_port, rpc.rpc_path);
+    ct::run_no_tty(handle, client);
+    break;
+  }
+  case Mode::Pipelined:
+    ct::run_no_tty_pipelined(handle, rpc);
+    break;
+  case Mode::Staged:
+    ct::run_no_tty_staged(handle, rpc);
+    break;
+  case Mode::Async:
+    ct::run_no_tty_async(handle, rpc);
+    break;
+  case Mode::Stages:
+    break;
+  }
+  double seconds = static_cast<double>(since(start)) / 1e9;
+  std::cout.rdbuf(cout_buf);
+  std::cin.rdbuf(cin_buf);
+
+  auto handled = static_cast<unsigned long long>(lines.size() * opts.repeat);
+  std::printf(
+      "mode=%s lines=%llu inflight=%zu workers=%zu connections=%zu wall=%.3fs throughput=%.0f lines/s\n",
+      name,
+      handled,
+      rpc.inflight,
+      rpc.workers,
+      rpc.connections,
+      seconds,
+      static_cast<double>(handled) / seconds
+  );
+}
+
+BenchOptions parse_args(int argc, char** argv) {
+  BenchOptions opts;
+  std::vector<std::string> positional;
+  auto usage = [] {
+    std::cerr << "usage: replay_bench <schema> <requests> [--mode stages|serial|pipelined|staged|async] "
+                 "[--encode direct|parse] [--threads N] [--inflight N] [--workers N] [--connections N] [--repeat R] "
+                 "[--canned] [--min-str A] [--max-str B]\n";
+    std::exit(2);
+  };
+  for (int k = 1; k < argc; k++) {
+    std::string a = argv[k];
+    auto value = [&] {
+      if (k + 1 >= argc) {
+        std::cerr << "missing value for " << a << '\n';
+        std::exit(2);
+      }
+      return std::string(argv[++k]);
+    };
+    auto next = [&] { return std::strtoull(value().c_str(), nullptr, 10); };
+    if (a == "--mode") {
+      std::string m = value();
+      if (m == "stages") {
+        opts.mode = Mode::Stages;
+      } else if (m == "serial") {
+        opts.mode = Mode::Serial;
+      } else if (m == "pipelined") {
+        opts.mode = Mode::Pipelined;
+      } else if (m == "staged") {
+        opts.mode = Mode::Staged;
+      } else if (m == "async") {
+        opts.mode = Mode::Async;
+      } else {
+        usage();
+      }
+    } else if (a == "--encode") {
+      std::string e = value();
+      if (e != "direct" && e != "parse") {
+        usage();
+      }
+      opts.direct = e == "direct";
+    } else if (a == "--threads") {
+      opts.threads = next();
+    } else if (a == "--inflight") {
+      opts.inflight = next();
+    } else if (a == "--workers") {
+      opts.workers = next();
+    } else if (a == "--connections") {
+      opts.connections = next();
+    } else if (a == "--repeat") {
+      opts.repeat = next();
+    } else if (a == "--canned") {
+      opts.canned = true;
+    } else if (a == "--min-str") {
+      opts.gen.min_string = next();
+    } else if (a == "--max-str") {
+      opts.gen.max_string = next();
+    } else {
+      positional.push_back(a);
+    }
+  }
+  if (positional.size() != 2) {
+    usage();
+  }
+  opts.schema_path = positional[0];
+  opts.requests_path = positional[1];
+  opts.threads = std::max<std::size_t>(opts.threads, 1);
+  opts.inflight = std::max<std::size_t>(opts.inflight, 1);
+  opts.workers = std::max<std::size_t>(opts.workers, 1);
+  opts.connections = std::max<std::size_t>(opts.connections, 1);
+  return opts;
+}
+
+// на каждую функцию схемы - обработчик, который копирует ответ, сгенерированный один раз при старте
+void add_canned(ct::HandlerRegistry& registry, const ct::Schema& sch, const ct::GenOptions& gen) {
+  std::mt19937_64 rng(1);
+  for (auto& [name, fn] : sch.functions) {
+    std::vector<std::byte> canned;
+    ct::generate_wire(fn.plan.ret, rng, gen, canned);
+    registry.add(
+        name,
+        [canned = std::move(canned)](const ct::Function&, std::span<const std::byte>, std::vector<std::byte>& resp) {
+          resp.assign(canned.begin(), canned.end());
+        }
+    );
+  }
+}
+
+const char* mode_name(Mode m) {
+  switch (m) {
+  case Mode::Stages:
+    return "stages";
+  case Mode::Serial:
+    return "serial";
+  case Mode::Pipelined:
+    return "pipelined";
+  case Mode::Staged:
+    return "staged";
+  case Mode::Async:
+    return "async";
+  }
+  return "";
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  BenchOptions opts = parse_args(argc, argv);
+  auto sch = std::make_shared<const ct::Schema>(ct::load_schema_file(opts.schema_path));
+  std::vector<std::string> lines;
+  {
+    std::ifstream in(opts.requests_path);
+    std::string line;
+    while (std::getline(in, line)) {
+      lines.push_back(std::move(line));
+    }
+  }
+
+  // сервер на любом свободном порту loopback, принимает любой путь
+  ct::HandlerRegistry registry(sch, 1, opts.gen);
+  if (opts.canned) {
+    add_canned(registry, *sch, opts.gen);
+  }
+  ct::Server server(registry, {"127.0.0.1", 0, ""});
+  std::jthread serving([&] { server.run(); });
+
+  ct::Options rpc;
+  rpc.rpc_host = "127.0.0.1";
+  rpc.rpc_port = server.port();
+  rpc.inflight = opts.inflight;
+  if (opts.mode == Mode::Staged) {
+    rpc.workers = opts.workers;
+  }
+  if (opts.mode == Mode::Async) {
+    rpc.connections = opts.connections;
+  }
+
+  if (opts.mode == Mode::Stages) {
+    run_stages(*sch, lines, opts, rpc);
+  } else {
+    ct::SchemaHandle handle(sch);
+    run_repl_mode(handle, lines, opts, rpc, mode_name(opts.mode));
+  }
+  server.stop();
+}
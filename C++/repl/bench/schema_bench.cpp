@@ -0,0 +1,89 @@
+// замер загрузки синтетических схем: ./schema_bench [N ...], по умолчанию 10k, 100k и 1M объявлений.
+// половина объявлений - структуры, ссылающиеся на предыдущую структуру, половина - функции над ними.
+// load - load_schema_file целиком с разбором (кеш схемы перед замером удаляется), plans - отдельно повторённые
+// compile_plans и build_completion_index, parse - разница: разбор текста, сборка схемы и запись её кеша.
+// собирается вместе с исходниками repl, кроме файла с main
+#include "../autocomplete.h"
+#include "../codec_plan.h"
+#include "../schema_cache.h"
+#include "../schema_loader.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// id функции - XXH32 имени, и среди сотен тысяч имён f<k> попадаются совпадения, на которых загрузка законно падает.
+// такому имени дописываем суффикс, пока id не станет свободным
+std::string function_name(std::size_t k, std::unordered_set<uint32_t>& ids) {
+  std::string name = "f" + std::to_string(k);
+  for (std::size_t n = 1; !ids.insert(ct::function_id(name)).second; n++) {
+    name = "f" + std::to_string(k) + "_" + std::to_string(n);
+  }
+  return name;
+}
+
+void write_schema(const std::string& path, std::size_t items) {
+  std::ofstream out(path, std::ios::binary);
+  std::unordered_set<uint32_t> ids;
+  for (std::size_t k = 0; k < items; k++) {
+    if (k % 2 == 0) {
+      out << "struct S" << k << " {\n  int32 a;\n  string b;\n  uint64 c;\n";
+      if (k >= 2) {
+        out << "  S" << k - 2 << " prev;\n";
+      }
+      out << "}\n";
+    } else {
+      out << "fn " << function_name(k, ids) << " -> S" << k - 1 << " {\n  int64 x;\n  S" << k - 1 << " s;\n}\n";
+    }
+  }
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::size_t> sizes;
+  for (int k = 1; k < argc; k++) {
+    sizes.push_back(std::strtoull(argv[k], nullptr, 10));
+  }
+  if (sizes.empty()) {
+    sizes = {10'000, 100'000, 1'000'000};
+  }
+  auto path = (std::filesystem::temp_directory_path() / "ct_schema_bench.schema").string();
+  std::string cache = ct::schema_cache_path(path);
+  auto since = [](std::chrono::steady_clock::time_point start) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(ns);
+  };
+  for (std::size_t items : sizes) {
+    write_schema(path, items);
+    std::filesystem::remove(cache);
+    auto bytes = std::filesystem::file_size(path);
+    auto start = std::chrono::steady_clock::now();
+    ct::Schema sch = ct::load_schema_file(path);
+    double load = since(start);
+    start = std::chrono::steady_clock::now();
+    ct::compile_plans(sch);
+    ct::build_completion_index(sch);
+    double plans = since(start);
+    std::printf(
+        "items=%zu bytes=%ju structs=%zu functions=%zu load=%.1f ms (%.0f ns/item) plans=%.1f ms parse=%.1f ms\n",
+        items,
+        static_cast<std::uintmax_t>(bytes),
+        sch.structs.size(),
+        sch.functions.size(),
+        load / 1e6,
+        load / static_cast<double>(items),
+        plans / 1e6,
+        (load - plans) / 1e6
+    );
+  }
+  std::filesystem::remove(path);
+  std::filesystem::remove(cache);
+}
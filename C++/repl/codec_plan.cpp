@@ -0,0 +1,115 @@
+#include "codec_plan.h"
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <xxhash.h>
+
+namespace ct {
+namespace {
+
+struct PlanCompiler {
+  const Schema& sch;
+
+  // label - то, что печатается перед значением: "" для возвращаемого значения, иначе "name=" с запятой при нужде.
+  // структура не разворачивается: её поля уже лежат в её собственном плане
+  PlanOp op(const Type& t, const std::string* name, std::string label) const {
+    if (t.is_builtin()) {
+      return {PlanOpKind::Builtin, t.builtin(), nullptr, name, std::move(label)};
+    }
+    const Struct* st = sch.find_struct(t);
+    if (!st) {
+      throw SchemaError("Error: Unknown type '" + t.str() + "'");
+    }
+    return {PlanOpKind::Struct, Builtin::Int32, st, name, std::move(label) + st->name + "{"};
+  }
+};
+
+// prefix уже содержит имена структур и полей, так что вместе с видом, примитивом и формой вложенной структуры он
+// описывает форму целиком
+void hash_op(std::string& shape, const PlanOp& op, const std::unordered_map<const Struct*, uint64_t>& shapes) {
+  shape.push_back(static_cast<char>(op.kind));
+  shape.push_back(static_cast<char>(op.builtin));
+  shape += op.prefix;
+  shape.push_back('\0');
+  if (op.kind == PlanOpKind::Struct) {
+    uint64_t nested = shapes.at(op.st);
+    shape.append(reinterpret_cast<const char*>(&nested), sizeof(nested));
+  }
+}
+
+// форма каждой структуры через её поля, вложенные раньше внешних. обход в глубину без рекурсии, чтобы длинная
+// цепочка вложенных структур не упёрлась в стек; структура, которая встречается снова, пока открыта, - взаимная
+// рекурсия. каждая структура проходится один раз, так что всё линейно по размеру схемы
+std::unordered_map<const Struct*, uint64_t> struct_shapes(const Schema& sch) {
+  enum class Mark {
+    Open,
+    Done
+  };
+  std::unordered_map<const Struct*, Mark> marks;
+  std::unordered_map<const Struct*, uint64_t> shapes;
+  std::vector<std::pair<const Struct*, std::size_t>> stack;
+  std::string shape;
+  for (auto& [_, root] : sch.structs) {
+    if (!marks.try_emplace(&root, Mark::Open).second) {
+      continue;
+    }
+    stack.emplace_back(&root, 0);
+    while (!stack.empty()) {
+      auto& [st, next] = stack.back();
+      if (next < st->plan.size()) {
+        const PlanOp& op = st->plan[next++];
+        if (op.kind != PlanOpKind::Struct) {
+          continue;
+        }
+        auto [mark, fresh] = marks.try_emplace(op.st, Mark::Open);
+        if (fresh) {
+          stack.emplace_back(op.st, 0);
+        } else if (mark->second == Mark::Open) {
+          throw SchemaError("Recursive struct");
+        }
+        continue;
+      }
+      shape.clear();
+      for (auto& field : st->plan) {
+        hash_op(shape, field, shapes);
+      }
+      shapes.emplace(st, XXH64(shape.data(), shape.size(), 0));
+      marks[st] = Mark::Done;
+      stack.pop_back();
+    }
+  }
+  return shapes;
+}
+} // namespace
+
+void compile_plans(Schema& sch) {
+  PlanCompiler pc{sch};
+  for (auto& [_, st] : sch.structs) {
+    st.field_index.clear();
+    st.plan.clear();
+    st.plan.reserve(st.fields.size());
+    for (std::size_t k = 0; k < st.fields.size(); k++) {
+      auto& f = st.fields[k];
+      st.field_index.emplace(f.name, static_cast<uint32_t>(k));
+      st.plan.push_back(pc.op(f.type, &f.name, (k == 0 ? "" : ", ") + f.name + "="));
+      st.plan.back().field = static_cast<uint32_t>(k);
+    }
+  }
+  auto shapes = struct_shapes(sch);
+  std::string shape;
+  for (auto& [_, fn] : sch.functions) {
+    CodecPlan plan;
+    plan.args.reserve(fn.args.size());
+    for (auto& a : fn.args) {
+      plan.args.push_back(pc.op(a.type, &a.name, ""));
+    }
+    plan.ret.push_back(pc.op(fn.return_type, nullptr, ""));
+    shape.clear();
+    hash_op(shape, plan.ret.front(), shapes);
+    plan.ret_shape = XXH64(shape.data(), shape.size(), 0);
+    fn.plan = std::move(plan);
+  }
+}
+} // namespace ct
@@ -0,0 +1,13 @@
+#pragma once
+#include "my_types.h"
+
+namespace ct {
+
+// заполняет Struct::field_index, компилирует план полей каждой структуры (Struct::plan) и для каждой функции схемы
+// план кодирования аргументов и декодирования ответа (Function::plan), который ссылается на планы структур.
+// бросает SchemaError на взаимно рекурсивные структуры. время и память линейны по размеру схемы.
+// ссылки на структуры и имена в плане уже разрешены, так что сериализатору не нужны find_struct в горячем пути.
+// планы указывают внутрь sch, поэтому схему после этого можно перемещать, но не копировать
+void compile_plans(Schema& sch);
+
+} // namespace ct
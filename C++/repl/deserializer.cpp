@@ -3,68 +3,86 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace ct {
-uint8_t Cursor::get8() {
-  if (i >= n) {
+const std::byte* Cursor::take(std::size_t len) {
+  if (n - i < len) {
     throw DeserError("EOF");
   }
-  return std::to_integer<uint8_t>(p[i++]);
+  const std::byte* start = p + i;
+  i += len;
+  return start;
 }
 
-std::string Cursor::get_string() {
+uint8_t Cursor::get8() {
+  return std::to_integer<uint8_t>(*take(1));
+}
+
+std::string_view Cursor::get_string() {
   uint32_t len = get_be<uint32_t>();
-  std::string s;
-  for (uint32_t k = 0; k < len; k++) {
-    s += char(get8());
-  }
-  return s;
+  const auto* start = reinterpret_cast<const char*>(take(len));
+  return {start, len};
 }
 
-void read_struct(Cursor& c, const Schema& sch, const Struct& st, std::string& out) {
-  out += st.name + "{";
-  bool first = true;
-  for (auto& f : st.fields) {
-    if (!first) {
-      out += ", ";
+void read_plan(Cursor& c, const std::vector<PlanOp>& plan, OutputBuffer& out) {
+  for (auto& op : plan) {
+    out.append(op.prefix);
+    if (op.kind == PlanOpKind::Struct) {
+      read_plan(c, op.st->plan, out);
+      out.push_back('}');
+      continue;
+    }
+    if (op.builtin == Builtin::String) {
+      out.push_back('"');
+      out.append(c.get_string());
+      out.push_back('"');
+    } else if (op.builtin == Builtin::Int32) {
+      out.append_int(c.get_be<int32_t>());
+    } else if (op.builtin == Builtin::Int64) {
+      out.append_int(c.get_be<int64_t>());
+    } else if (op.builtin == Builtin::Uint32) {
+      out.append_int(c.get_be<uint32_t>());
+    } else if (op.builtin == Builtin::Uint64) {
+      out.append_int(c.get_be<uint64_t>());
     }
-    out += f.name + "=";
-    read_value(c, sch, f.type, out);
-    first = false;
   }
-  out += "}";
 }
 
-void read_value(Cursor& c, const Schema& sch, const Type& t, std::string& out) {
-  if (t.is_builtin()) {
-    if (*t.builtin == Builtin::String) {
-      auto s = c.get_string();
-      out += "\"" + s + "\"";
-    } else if (*t.builtin == Builtin::Int32) {
-      out += std::to_string(c.get_be<int32_t>());
-    } else if (*t.builtin == Builtin::Int64) {
-      out += std::to_string(c.get_be<int64_t>());
-    } else if (*t.builtin == Builtin::Uint32) {
-      out += std::to_string(c.get_be<uint32_t>());
-    } else if (*t.builtin == Builtin::Uint64) {
-      out += std::to_string(c.get_be<uint64_t>());
+void skip_plan(Cursor& c, const std::vector<PlanOp>& plan) {
+  for (auto& op : plan) {
+    if (op.kind == PlanOpKind::Struct) {
+      skip_plan(c, op.st->plan);
+      continue;
     }
-  } else {
-    auto st = sch.find_struct(*t.user);
-    if (!st) {
-      throw DeserError("unknown struct type");
+    if (op.builtin == Builtin::String) {
+      c.get_string();
+    } else if (op.builtin == Builtin::Int32 || op.builtin == Builtin::Uint32) {
+      c.take(sizeof(uint32_t));
+    } else {
+      c.take(sizeof(uint64_t));
     }
-    read_struct(c, sch, *st, out);
   }
 }
 
-std::string deserialize_response_to_string(const Schema& sch, const Function& fn, std::span<const std::byte> bytes) {
-  Cursor cur{bytes.data(), bytes.size()};
-  std::string out;
-  read_value(cur, sch, fn.return_type, out);
-  if (cur.i != cur.n) {
-    throw DeserError("extra bytes after response value");
+void deserialize_response(const Function& fn, std::span<const std::byte> bytes, OutputBuffer& out) {
+  std::size_t before = out.size();
+  try {
+    Cursor cur{bytes.data(), bytes.size()};
+    read_plan(cur, fn.plan.ret, out);
+    if (cur.i != cur.n) {
+      throw DeserError("extra bytes after response value");
+    }
+  } catch (...) {
+    out.truncate(before);
+    throw;
   }
-  return out;
+}
+
+std::string deserialize_response_to_string(const Schema&, const Function& fn, std::span<const std::byte> bytes) {
+  thread_local OutputBuffer buf;
+  buf.clear();
+  deserialize_response(fn, bytes, buf);
+  return std::string(buf.view());
 }
 } // namespace ct
@@ -1,12 +1,15 @@
 #pragma once
 #include "endian.h"
 #include "my_types.h"
+#include "output_buffer.h"
 
 #include <cstddef>
 #include <cstdint>
 #include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace ct {
 struct DeserError : std::runtime_error {
@@ -18,23 +21,29 @@ struct Cursor {
   std::size_t n;
   std::size_t i = 0;
 
+  // одна проверка границ на весь кусок из len байт, возвращает его начало
+  const std::byte* take(std::size_t len);
+
   uint8_t get8();
 
   template <typename T>
   T get_be() {
-    T v = 0;
-    for (size_t k = 0; k < sizeof(T); k++) {
-      v = (v << 8) | get8();
-    }
-    return v;
+    return load_be<T>(take(sizeof(T)));
   }
 
-  std::string get_string();
+  // строка не копируется: view смотрит прямо в буфер ответа и живёт, пока жив он
+  std::string_view get_string();
 };
 
-void read_value(Cursor& c, const Schema& sch, const Type& t, std::string& out);
+// разбираем значение по плану (Function::plan.ret) и дописываем его текстом в out. поля вложенной структуры идут
+// по её Struct::plan
+void read_plan(Cursor& c, const std::vector<PlanOp>& plan, OutputBuffer& out);
+
+// проверяет, что значение по плану целиком лежит в c, и сдвигает курсор за него, ничего не печатая
+void skip_plan(Cursor& c, const std::vector<PlanOp>& plan);
 
-void read_struct(Cursor& c, const Schema& sch, const Struct& st, std::string& out);
+// дописывает текст ответа в out. если ответ битый, out откатывается к тому, что в нём было до вызова
+void deserialize_response(const Function& fn, std::span<const std::byte> bytes, OutputBuffer& out);
 
 std::string deserialize_response_to_string(const Schema& sch, const Function& fn, std::span<const std::byte> bytes);
 } // namespace ct
@@ -0,0 +1,291 @@
+#include "direct_encoder.h"
+
+#include "endian.h"
+#include "request_parser.h"
+#include "serializer.h"
+
+#include <cctype>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+
+namespace ct {
+namespace {
+
+enum class SlotState {
+  Absent,
+  Present,
+  Error
+};
+
+// слот аргумента или поля структуры: какая операция плана его кодирует и где в scratch лежат его байты.
+// аргументы приходят в любом порядке, поэтому сначала раскладываем их по слотам, а склеиваем уже в порядке схемы
+struct Slot {
+  const PlanOp* op;
+  SlotState state = SlotState::Absent;
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  std::string error{};
+};
+
+class DirectEncoder {
+public:
+  DirectEncoder(Lexer& lx, std::vector<std::byte>& buf, std::vector<Slot>& slots)
+      : lx_(lx)
+      , buf_(buf)
+      , slots_(slots) {}
+
+  // слоты для операций ops: аргументов функции или полей одной структуры (Struct::plan)
+  std::size_t open_frame(const std::vector<PlanOp>& ops) {
+    std::size_t base = slots_.size();
+    for (auto& op : ops) {
+      slots_.push_back({&op});
+    }
+    return base;
+  }
+
+  // читает "name = value, ..." до close. значения, у которых есть слот в [base, slots_.size()), кодируются,
+  // остальные (неизвестные имена, повторы аргументов) только разбираются.
+  // в литерале структуры повтор поля - синтаксическая ошибка, как и в RequestParser
+  void members(char close, std::size_t base, bool struct_lit) {
+    std::vector<std::string_view> unknown;
+    lx_.skip_ws();
+    if (lx_.consume(close)) {
+      return;
+    }
+    for (;;) {
+      std::string_view name = lx_.ident();
+      lx_.except('=');
+      std::size_t idx = find_slot(base, name);
+      if (idx == slots_.size()) {
+        skip_value();
+        if (struct_lit) {
+          for (auto& u : unknown) {
+            if (u == name) {
+              throw ParseError("duplicate field in struct");
+            }
+          }
+          unknown.push_back(name);
+        }
+      } else if (slots_[idx].state != SlotState::Absent) {
+        skip_value();
+        if (struct_lit) {
+          throw ParseError("duplicate field in struct");
+        }
+      } else {
+        value(idx);
+      }
+      lx_.skip_ws();
+      if (lx_.consume(close)) {
+        break;
+      }
+      lx_.except(',');
+      lx_.skip_ws();
+    }
+  }
+
+  // склеиваем байты слотов [base, end) в порядке схемы. возвращаем первую по порядку схемы ошибку
+  std::optional<std::string> assemble(std::size_t base, const Struct* st, std::size_t& begin, std::size_t& end) {
+    for (std::size_t k = base; k < slots_.size(); k++) {
+      if (slots_[k].state == SlotState::Absent) {
+        if (st) {
+          return "missing struct field '" + *slots_[k].op->name + "' for '" + st->name + "'";
+        }
+        return "missing arg";
+      }
+      if (slots_[k].state == SlotState::Error) {
+        return slots_[k].error;
+      }
+    }
+    if (base == slots_.size()) {
+      begin = end = buf_.size();
+      return std::nullopt;
+    }
+    // обычно значения идут в порядке схемы и уже лежат подряд - тогда ничего не копируем
+    bool contiguous = true;
+    std::size_t total = 0;
+    for (std::size_t k = base; k < slots_.size(); k++) {
+      total += slots_[k].end - slots_[k].begin;
+      if (k + 1 < slots_.size() && slots_[k].end != slots_[k + 1].begin) {
+        contiguous = false;
+      }
+    }
+    if (contiguous) {
+      begin = slots_[base].begin;
+      end = slots_.back().end;
+      return std::nullopt;
+    }
+    begin = buf_.size();
+    buf_.resize(begin + total);
+    std::byte* dst = buf_.data() + begin;
+    for (std::size_t k = base; k < slots_.size(); k++) {
+      std::size_t len = slots_[k].end - slots_[k].begin;
+      std::memcpy(dst, buf_.data() + slots_[k].begin, len);
+      dst += len;
+    }
+    end = buf_.size();
+    return std::nullopt;
+  }
+
+private:
+  std::size_t find_slot(std::size_t base, std::string_view name) const {
+    for (std::size_t k = base; k < slots_.size(); k++) {
+      if (*slots_[k].op->name == name) {
+        return k;
+      }
+    }
+    return slots_.size();
+  }
+
+  void fail(std::size_t idx, std::string error) {
+    slots_[idx].state = SlotState::Error;
+    slots_[idx].error = std::move(error);
+  }
+
+  static bool starts_struct(char c) {
+    return c == '{' || std::isalpha(c) || c == '_';
+  }
+
+  // имя структуры (если есть) и '{'. возвращает имя
+  std::string_view struct_open() {
+    std::string_view name;
+    if (lx_.peek() != '{') {
+      name = lx_.ident();
+      lx_.skip_ws();
+      if (!lx_.consume('{')) {
+        throw ParseError("excepted '{' to start struct literal");
+      }
+    } else {
+      lx_.get();
+    }
+    return name;
+  }
+
+  Value integer_value() {
+    return std::visit([](auto x) { return Value(x); }, lx_.integer());
+  }
+
+  // разбор значения без кодирования, с теми же синтаксическими проверками, что в RequestParser::parse_value
+  void skip_value() {
+    lx_.skip_ws();
+    char c = lx_.peek();
+    if (c == '"') {
+      lx_.string_lit();
+    } else if (starts_struct(c)) {
+      struct_open();
+      std::size_t base = slots_.size();
+      members('}', base, true);
+    } else {
+      lx_.integer();
+    }
+  }
+
+  void value(std::size_t idx) {
+    const PlanOp& op = *slots_[idx].op;
+    lx_.skip_ws();
+    char c = lx_.peek();
+    if (op.kind == PlanOpKind::Builtin) {
+      if (starts_struct(c)) {
+        skip_value();
+        fail(idx, "excepted " + Type::builtin_of(op.builtin).str());
+        return;
+      }
+      if (c == '"' && op.builtin != Builtin::String) {
+        lx_.string_lit();
+        fail(idx, "excepted " + Type::builtin_of(op.builtin).str());
+        return;
+      }
+      try {
+        // строка кодируется прямо из view лексера, без Value
+        Value v;
+        WireItem it{Builtin::String};
+        if (c == '"') {
+          it.str = lx_.string_lit();
+        } else {
+          v = integer_value();
+          it = to_wire_item(op.builtin, v);
+        }
+        std::size_t begin = buf_.size();
+        buf_.resize(begin + wire_size(it));
+        write_wire_item(buf_.data() + begin, it);
+        slots_[idx].state = SlotState::Present;
+        slots_[idx].begin = begin;
+        slots_[idx].end = buf_.size();
+      } catch (const SerializeError& e) {
+        fail(idx, e.what());
+      }
+      return;
+    }
+
+    if (!starts_struct(c)) {
+      skip_value();
+      fail(idx, "excepted struct '" + op.st->name + "'");
+      return;
+    }
+    std::string_view given = struct_open();
+    if (!given.empty() && given != op.st->name) {
+      std::size_t base = slots_.size();
+      members('}', base, true);
+      fail(idx, "struct literal name mismatch");
+      return;
+    }
+    std::size_t base = open_frame(op.st->plan);
+    members('}', base, true);
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    auto error = assemble(base, op.st, begin, end);
+    slots_.resize(base);
+    if (error) {
+      fail(idx, std::move(*error));
+      return;
+    }
+    slots_[idx].state = SlotState::Present;
+    slots_[idx].begin = begin;
+    slots_[idx].end = end;
+  }
+
+  Lexer& lx_;
+  std::vector<std::byte>& buf_;
+  std::vector<Slot>& slots_;
+};
+
+const std::vector<PlanOp> NO_OPS;
+} // namespace
+
+const Function& encode_request(const Schema& sch, std::string_view line, std::vector<std::byte>& out) {
+  thread_local std::vector<std::byte> scratch;
+  thread_local std::vector<Slot> slots;
+  scratch.clear();
+  slots.clear();
+
+  Lexer lx(line);
+  std::string_view func_name = lx.ident();
+  lx.except('(');
+  const Function* fn = sch.find_function(func_name);
+  const auto& ops = fn ? fn->plan.args : NO_OPS;
+
+  DirectEncoder enc(lx, scratch, slots);
+  std::size_t base = enc.open_frame(ops);
+  enc.members(')', base, false);
+  lx.skip_ws();
+  if (!lx.eof()) {
+    throw ParseError("trailing characters after ')'");
+  }
+  if (!fn) {
+    throw SerializeError("unknown function '" + std::string(func_name) + "'");
+  }
+
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  if (auto error = enc.assemble(base, nullptr, begin, end)) {
+    throw SerializeError(*error);
+  }
+  out.clear();
+  out.reserve(sizeof(uint32_t) + end - begin);
+  put_be<uint32_t>(out, fn->id);
+  out.insert(out.end(), scratch.begin() + begin, scratch.begin() + end);
+  return *fn;
+}
+} // namespace ct
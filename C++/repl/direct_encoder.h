@@ -0,0 +1,16 @@
+#pragma once
+#include "my_types.h"
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace ct {
+
+// быстрый путь рядом с RequestParser: строка запроса разбирается прямо по сигнатуре функции (её Function::plan) и
+// сразу превращается в байты на проводе в out, без дерева Value и без промежуточной map аргументов.
+// ошибки те же и в том же порядке, что у RequestParser::parse + serialize_call: сначала синтаксические (ParseError),
+// потом первая в порядке схемы ошибка сериализации (SerializeError)
+const Function& encode_request(const Schema& sch, std::string_view line, std::vector<std::byte>& out);
+
+} // namespace ct
@@ -1,17 +1,54 @@
 #pragma once
+#include <bit>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <span>
 #include <vector>
 
 namespace ct {
+template <typename U>
+constexpr U byteswap(U v) {
+  if constexpr (sizeof(U) == 1) {
+    return v;
+  } else if constexpr (sizeof(U) == 2) {
+    return __builtin_bswap16(v);
+  } else if constexpr (sizeof(U) == 4) {
+    return __builtin_bswap32(v);
+  } else {
+    static_assert(sizeof(U) == 8);
+    return __builtin_bswap64(v);
+  }
+}
+
+// читаем big-endian число одной загрузкой: memcpy + разворот байтов (на big-endian машине разворота нет)
 template <typename T>
-void put_be(std::vector<std::byte>& out, T v) {
+T load_be(const std::byte* src) {
+  using U = std::make_unsigned_t<T>;
+  U uv;
+  std::memcpy(&uv, src, sizeof(U));
+  if constexpr (std::endian::native == std::endian::little) {
+    uv = byteswap(uv);
+  }
+  return static_cast<T>(uv);
+}
+
+// парная к load_be запись: разворот байтов + одна запись по адресу dst
+template <typename T>
+void store_be(std::byte* dst, T v) {
   using U = std::make_unsigned_t<T>;
   U uv = static_cast<U>(v);
-  for (int s = (sizeof(T) - 1) * 8; s >= 0; s -= 8) {
-    out.push_back(std::byte((uv >> s) & 0xff));
+  if constexpr (std::endian::native == std::endian::little) {
+    uv = byteswap(uv);
   }
+  std::memcpy(dst, &uv, sizeof(U));
+}
+
+template <typename T>
+void put_be(std::vector<std::byte>& out, T v) {
+  std::size_t pos = out.size();
+  out.resize(pos + sizeof(T));
+  store_be<T>(out.data() + pos, v);
 }
 
 void put_bytes(std::vector<std::byte>& out, std::span<const std::byte> bytes);
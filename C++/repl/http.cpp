@@ -0,0 +1,84 @@
+#include "http.h"
+
+#include <cctype>
+#include <charconv>
+
+namespace ct {
+namespace {
+
+bool iequals(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (std::size_t k = 0; k < a.size(); k++) {
+    if (std::tolower(static_cast<unsigned char>(a[k])) != std::tolower(static_cast<unsigned char>(b[k]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+} // namespace
+
+std::optional<HttpHead> parse_http_head(std::string_view buf, std::size_t max_head, std::size_t max_body) {
+  std::size_t end = buf.find("\r\n\r\n");
+  if (end == std::string_view::npos) {
+    if (buf.size() > max_head) {
+      throw HttpError("head too large");
+    }
+    return std::nullopt;
+  }
+  HttpHead head;
+  head.size = end + 4;
+  std::string_view rest = buf.substr(0, end + 2);
+  auto next_line = [&] {
+    std::size_t eol = rest.find("\r\n");
+    std::string_view line = rest.substr(0, eol);
+    rest.remove_prefix(eol + 2);
+    return line;
+  };
+
+  std::string_view line = next_line();
+  std::size_t sp1 = line.find(' ');
+  std::size_t sp2 = line.find(' ', sp1 == std::string_view::npos ? sp1 : sp1 + 1);
+  if (sp1 == std::string_view::npos || sp2 == std::string_view::npos) {
+    throw HttpError("malformed start line");
+  }
+  head.first = line.substr(0, sp1);
+  head.second = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  head.third = line.substr(sp2 + 1);
+
+  while (!rest.empty()) {
+    line = next_line();
+    std::size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      throw HttpError("malformed header");
+    }
+    std::string_view name = line.substr(0, colon);
+    std::string_view value = trim(line.substr(colon + 1));
+    if (iequals(name, "Content-Length")) {
+      auto res = std::from_chars(value.data(), value.data() + value.size(), head.content_length);
+      if (res.ec != std::errc() || res.ptr != value.data() + value.size()) {
+        throw HttpError("bad Content-Length");
+      }
+      if (head.content_length > max_body) {
+        throw HttpError("body too large");
+      }
+    } else if (iequals(name, "Connection")) {
+      head.connection_close = iequals(value, "close");
+    } else if (iequals(name, "Transfer-Encoding")) {
+      throw HttpError("chunked bodies are not supported");
+    }
+  }
+  return head;
+}
+} // namespace ct
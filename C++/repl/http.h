@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace ct {
+
+// заголовок не разбирается: нет первой строки, битая строка заголовка, плохой Content-Length, chunked-тело
+struct HttpError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// заголовок HTTP/1.1 сообщения, как его видят rpc_server.h и async_client.h: тело всегда идёт с Content-Length
+struct HttpHead {
+  // первая строка по пробелам: у запроса метод, путь и версия, у ответа версия, код и пояснение
+  std::string_view first;
+  std::string_view second;
+  std::string_view third;
+  // длина заголовка вместе с пустой строкой после него
+  std::size_t size;
+  std::size_t content_length = 0;
+  // значение заголовка Connection; без него соединение живёт, если версия не HTTP/1.0
+  std::optional<bool> connection_close;
+};
+
+// nullopt - заголовок ещё не пришёл целиком. бросает HttpError, если заголовок длиннее max_head или тело длиннее
+// max_body
+std::optional<HttpHead> parse_http_head(std::string_view buf, std::size_t max_head, std::size_t max_body);
+
+} // namespace ct
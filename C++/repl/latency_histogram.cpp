@@ -0,0 +1,68 @@
+#include "latency_histogram.h"
+
+#include <bit>
+#include <cmath>
+#include <cstdio>
+
+namespace ct {
+
+// до 2 * SUB значение само себе корзина, дальше - номер октавы и старшие SUB_BITS + 1 бит значения
+std::size_t LatencyHistogram::bucket_of(uint64_t ns) {
+  if (ns < 2 * SUB) {
+    return static_cast<std::size_t>(ns);
+  }
+  unsigned shift = static_cast<unsigned>(std::bit_width(ns)) - 1 - SUB_BITS;
+  return shift * SUB + static_cast<std::size_t>(ns >> shift);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (std::size_t k = 0; k < BUCKETS; k++) {
+    counts_[k] += other.counts_[k];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  if (other.max_ > max_) {
+    max_ = other.max_;
+  }
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  auto rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count_)));
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (std::size_t k = 0; k < BUCKETS; k++) {
+    seen += counts_[k];
+    if (seen >= rank) {
+      if (k < 2 * SUB) {
+        return k;
+      }
+      std::size_t shift = k / SUB - 1;
+      uint64_t low = static_cast<uint64_t>(k % SUB + SUB) << shift;
+      uint64_t mid = low + ((uint64_t(1) << shift) >> 1);
+      return mid < max_ ? mid : max_;
+    }
+  }
+  return max_;
+}
+
+void LatencyHistogram::print(std::ostream& os, std::string_view name) const {
+  char line[256];
+  std::snprintf(
+      line,
+      sizeof(line),
+      " n=%llu mean=%.2fus p50=%.2fus p99=%.2fus p999=%.2fus max=%.2fus\n",
+      static_cast<unsigned long long>(count_),
+      mean() / 1e3,
+      percentile(0.5) / 1e3,
+      percentile(0.99) / 1e3,
+      percentile(0.999) / 1e3,
+      max_ / 1e3
+  );
+  os << name << line;
+}
+} // namespace ct
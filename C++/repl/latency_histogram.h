@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+namespace ct {
+
+// гистограмма задержек в наносекундах с логарифмическими корзинами: на каждую степень двойки 64 корзины, так что
+// ошибка перцентиля не больше ~1.5%, а память постоянная при любом числе замеров.
+// не потокобезопасна: у каждого потока своя, в конце их складывают через merge
+class LatencyHistogram {
+public:
+  static constexpr unsigned SUB_BITS = 6;
+  static constexpr std::size_t SUB = std::size_t(1) << SUB_BITS;
+  static constexpr std::size_t BUCKETS = (64 - SUB_BITS) * SUB + SUB;
+
+  void record(uint64_t ns) {
+    counts_[bucket_of(ns)]++;
+    count_++;
+    sum_ += ns;
+    if (ns > max_) {
+      max_ = ns;
+    }
+  }
+
+  void merge(const LatencyHistogram& other);
+
+  uint64_t count() const {
+    return count_;
+  }
+
+  uint64_t max() const {
+    return max_;
+  }
+
+  double mean() const {
+    return count_ == 0 ? 0 : static_cast<double>(sum_) / static_cast<double>(count_);
+  }
+
+  // значение, не меньше которого q-я доля замеров (q в [0, 1]); середина корзины
+  uint64_t percentile(double q) const;
+
+  // одна строка: "<name> n=... mean=... p50=... p99=... p999=... max=..." в микросекундах
+  void print(std::ostream& os, std::string_view name) const;
+
+  static std::size_t bucket_of(uint64_t ns);
+
+private:
+  std::array<uint64_t, BUCKETS> counts_{};
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t max_ = 0;
+};
+
+} // namespace ct
@@ -0,0 +1,186 @@
+#include "load_generator.h"
+
+#include "bounded_queue.h"
+#include "deserializer.h"
+#include "latency_histogram.h"
+#include "output_buffer.h"
+#include "request_classes.h"
+#include "serializer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ct {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// запросы, которые уже пора отправить, но все отправители заняты. дальше расписание встаёт, но задержки по-прежнему
+// считаются от назначенного момента, так что остановка не прячется
+constexpr std::size_t MAX_BACKLOG = 1 << 20;
+
+// назначенный запрос: функция и seed выбираются по расписанию, так что при одном --seed запросы те же, какой бы
+// отправитель их ни взял
+struct Shot {
+  Clock::time_point intended;
+  const Function* fn;
+  uint64_t seed;
+};
+
+struct SenderStats {
+  // от назначенного момента до разобранного ответа или до ошибки: запросы, упавшие по таймауту, тоже тут, иначе
+  // зависание сервера пропало бы из хвоста
+  LatencyHistogram latency;
+  // от назначенного момента до начала отправки: сколько запрос ждал свободного отправителя
+  LatencyHistogram lag;
+  // от начала отправки до ответа
+  LatencyHistogram service;
+  // от назначенного момента до ошибки, только неудавшиеся запросы
+  LatencyHistogram failed;
+  uint64_t errors = 0;
+  std::string first_error;
+
+  void merge(const SenderStats& o) {
+    latency.merge(o.latency);
+    lag.merge(o.lag);
+    service.merge(o.service);
+    failed.merge(o.failed);
+    errors += o.errors;
+    if (first_error.empty()) {
+      first_error = o.first_error;
+    }
+  }
+};
+
+uint64_t ns_between(Clock::time_point from, Clock::time_point to) {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+  return ns < 0 ? 0 : static_cast<uint64_t>(ns);
+}
+
+// функции в порядке id, чтобы выбор по seed не зависел от порядка обхода хеш-таблицы
+std::vector<const Function*> pick_functions(const Schema& sch, const LoadOptions& opts) {
+  std::vector<const Function*> fns;
+  if (opts.functions.empty()) {
+    for (auto& [name, fn] : sch.functions) {
+      fns.push_back(&fn);
+    }
+    std::sort(fns.begin(), fns.end(), [](const Function* a, const Function* b) { return a->id < b->id; });
+  }
+  for (auto& name : opts.functions) {
+    const Function* fn = sch.find_function(name);
+    if (!fn) {
+      throw std::runtime_error("unknown function '" + name + "'");
+    }
+    fns.push_back(fn);
+  }
+  if (fns.empty()) {
+    throw std::runtime_error("schema has no functions");
+  }
+  return fns;
+}
+
+void send_shots(const Schema& sch, const Options& opts, BoundedQueue<Shot>& shots, SenderStats& st) {
+  rpc::Client client(opts.rpc_host, opts.rpc_port, opts.rpc_path);
+  RequestArena arena;
+  std::vector<std::byte> req;
+  OutputBuffer out;
+  while (auto shot = shots.pop()) {
+    try {
+      arena.reset();
+      std::mt19937_64 rng(shot->seed);
+      Call call = generate_call(*shot->fn, rng, opts.load.gen, arena.resource());
+      serialize_call_into(sch, call, req, arena.resource());
+      auto start = Clock::now();
+      auto resp = client.send(req);
+      out.clear();
+      deserialize_response(*shot->fn, resp, out);
+      auto end = Clock::now();
+      st.lag.record(ns_between(shot->intended, start));
+      st.service.record(ns_between(start, end));
+      st.latency.record(ns_between(shot->intended, end));
+    } catch (const std::runtime_error& e) {
+      auto end = Clock::now();
+      st.latency.record(ns_between(shot->intended, end));
+      st.failed.record(ns_between(shot->intended, end));
+      if (st.errors++ == 0) {
+        st.first_error = e.what();
+      }
+    }
+  }
+}
+} // namespace
+
+void run_load_generator(const SchemaHandle& handle, const Options& opts) {
+  // вся нагрузка идёт по одной версии схемы, перезагрузка на неё не влияет
+  std::shared_ptr<const Schema> sch = handle.load();
+  const LoadOptions& lo = opts.load;
+  std::vector<const Function*> fns;
+  try {
+    fns = pick_functions(*sch, lo);
+    if (!(lo.rate > 0) || !(lo.duration > 0)) {
+      throw std::runtime_error("rate and duration must be positive");
+    }
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Error: " << e.what() << '\n';
+    std::exit(1);
+  }
+  std::size_t senders = opts.inflight == 0 ? 1 : opts.inflight;
+  auto total = static_cast<uint64_t>(lo.rate * lo.duration);
+  std::chrono::duration<double> period(1 / lo.rate);
+
+  BoundedQueue<Shot> shots(MAX_BACKLOG);
+  std::vector<SenderStats> stats(senders);
+  Clock::time_point start;
+  {
+    std::vector<std::jthread> threads;
+    for (auto& st : stats) {
+      threads.emplace_back([&, &st = st] { send_shots(*sch, opts, shots, st); });
+    }
+    // момент k-го запроса считается от начала, а не от предыдущего, поэтому опоздание планировщика не копится
+    std::mt19937_64 rng(lo.seed);
+    std::uniform_int_distribution<std::size_t> pick(0, fns.size() - 1);
+    start = Clock::now();
+    for (uint64_t k = 0; k < total; k++) {
+      auto intended = start + std::chrono::duration_cast<Clock::duration>(period * static_cast<double>(k));
+      std::this_thread::sleep_until(intended);
+      const Function* fn = fns[pick(rng)];
+      shots.push({intended, fn, rng()});
+    }
+    shots.close();
+  }
+  double seconds = static_cast<double>(ns_between(start, Clock::now())) / 1e9;
+
+  SenderStats all;
+  for (auto& st : stats) {
+    all.merge(st);
+  }
+  std::printf(
+      "requests=%llu errors=%llu senders=%zu target=%.0f/s achieved=%.0f/s wall=%.3fs\n",
+      static_cast<unsigned long long>(total),
+      static_cast<unsigned long long>(all.errors),
+      senders,
+      lo.rate,
+      static_cast<double>(all.service.count()) / seconds,
+      seconds
+  );
+  if (!all.first_error.empty()) {
+    std::printf("first error: %s\n", all.first_error.c_str());
+  }
+  std::fflush(stdout);
+  all.latency.print(std::cout, "latency");
+  all.lag.print(std::cout, "lag    ");
+  all.service.print(std::cout, "service");
+  if (all.errors > 0) {
+    all.failed.print(std::cout, "failed ");
+  }
+}
+} // namespace ct
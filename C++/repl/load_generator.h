@@ -0,0 +1,14 @@
+#pragma once
+#include "repl.h"
+
+namespace ct {
+
+// синтетическая нагрузка по схеме: случайные корректные вызовы функций из opts.load.functions (generate_call)
+// отправляются через serialize_call и rpc::Client с постоянной частотой opts.load.rate в течение opts.load.duration.
+// расписание открытое: момент отправки k-го запроса назначен заранее и не ждёт ответов на предыдущие, а задержка
+// считается от назначенного момента, так что зависание сервера видно в перцентилях, а не прячется в паузе между
+// запросами. отправителей opts.inflight, у каждого своё соединение. в конце печатает число запросов, ошибки,
+// достигнутую частоту и гистограммы задержек
+void run_load_generator(const SchemaHandle& sch, const Options& opts);
+
+} // namespace ct
@@ -0,0 +1,42 @@
+#include "mapped_file.h"
+
+#include "my_types.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ct {
+
+MappedFile::MappedFile(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw SchemaError("Cannot open schema file: " + path);
+  }
+  struct stat st {};
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw SchemaError("Cannot open schema file: " + path);
+  }
+  size_ = static_cast<std::size_t>(st.st_size);
+  if (size_ != 0) {
+    void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      ::close(fd);
+      throw SchemaError("Cannot map schema file: " + path);
+    }
+    data_ = p;
+    // парсер идёт по тексту один раз подряд
+    ::madvise(data_, size_, MADV_SEQUENTIAL);
+  }
+  // отображение живёт и без дескриптора
+  ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    ::munmap(data_, size_);
+  }
+}
+} // namespace ct
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace ct {
+
+// файл, отображённый в память только для чтения. текст не копируется: view() смотрит прямо в страницы файла и
+// валиден, пока жив объект. пустой файл отображать нельзя, для него view() просто пустой
+class MappedFile {
+public:
+  // бросает SchemaError, если файл не открыть или не отобразить
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  std::string_view view() const {
+    return {static_cast<const char*>(data_), size_};
+  }
+
+private:
+  void* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+} // namespace ct
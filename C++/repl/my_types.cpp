@@ -1,47 +1,119 @@
 #include "my_types.h"
 
+#include <xxhash.h>
+
 namespace ct {
 
 Type Type::builtin_of(Builtin b) {
-  return Type{b, std::nullopt};
+  return Type{BUILTIN_TAG | static_cast<uint32_t>(b)};
 }
 
 Type Type::user_of(std::string_view b) {
-  return Type{std::nullopt, std::string(b)};
+  return user_of(Symbols::intern(b));
+}
+
+Type Type::user_of(Symbol s) {
+  return Type{s};
 }
 
 std::string Type::str() const {
-  if (builtin) {
-    if (*builtin == Builtin::Int32) {
+  if (is_builtin()) {
+    Builtin b = builtin();
+    if (b == Builtin::Int32) {
       return "int32";
     }
-    if (*builtin == Builtin::Int64) {
+    if (b == Builtin::Int64) {
       return "int64";
     }
-    if (*builtin == Builtin::Uint32) {
+    if (b == Builtin::Uint32) {
       return "uint32";
     }
-    if (*builtin == Builtin::Uint64) {
+    if (b == Builtin::Uint64) {
       return "uint64";
     }
-    if (*builtin == Builtin::String) {
+    if (b == Builtin::String) {
       return "string";
     }
   }
-  return *user;
+  return std::string(user_name());
 }
 
 bool Type::is_builtin() const {
-  return builtin.has_value();
+  return (bits & BUILTIN_TAG) != 0;
 }
 
-const Struct* Schema::find_struct(std::string_view n) const {
-  auto it = structs.find(std::string(n));
+Builtin Type::builtin() const {
+  return static_cast<Builtin>(bits & ~BUILTIN_TAG);
+}
+
+Symbol Type::user() const {
+  return bits;
+}
+
+std::string_view Type::user_name() const {
+  return Symbols::name(user());
+}
+
+std::size_t Struct::find_field(std::string_view n) const {
+  auto it = field_index.find(n);
+  return it == field_index.end() ? npos : it->second;
+}
+
+const Struct* Schema::find_struct(Symbol s) const {
+  auto it = structs.find(s);
   return it == structs.end() ? nullptr : &it->second;
 }
 
+const Struct* Schema::find_struct(Type t) const {
+  return t.is_builtin() ? nullptr : find_struct(t.user());
+}
+
+// имя, которого нет в Symbols, не может быть и среди структур
+const Struct* Schema::find_struct(std::string_view n) const {
+  auto s = Symbols::find(n);
+  return s ? find_struct(*s) : nullptr;
+}
+
 const Function* Schema::find_function(std::string_view n) const {
-  auto it = functions.find(std::string(n));
+  auto it = functions.find(n);
   return it == functions.end() ? nullptr : &it->second;
 }
+const Function* Schema::find_function_by_id(uint32_t id) const {
+  return by_id.find(id);
+}
+
+uint32_t function_id(std::string_view name) {
+  return XXH32(name.data(), name.size(), 0);
+}
+
+void FunctionIdTable::build(const FunctionMap& functions) {
+  std::size_t cap = 2;
+  while (cap < functions.size() * 2) {
+    cap *= 2;
+  }
+  slots_.assign(cap, nullptr);
+  mask_ = static_cast<uint32_t>(cap - 1);
+  for (auto& [_, fn] : functions) {
+    uint32_t pos = fn.id & mask_;
+    while (slots_[pos]) {
+      if (slots_[pos]->id == fn.id) {
+        throw SchemaError("Error: Functions '" + slots_[pos]->name + "' and '" + fn.name + "' have the same id");
+      }
+      pos = (pos + 1) & mask_;
+    }
+    slots_[pos] = &fn;
+  }
+}
+
+const Function* FunctionIdTable::find(uint32_t id) const {
+  if (slots_.empty()) {
+    return nullptr;
+  }
+  for (uint32_t pos = id & mask_; slots_[pos]; pos = (pos + 1) & mask_) {
+    if (slots_[pos]->id == id) {
+      return slots_[pos];
+    }
+  }
+  return nullptr;
+}
 } // namespace ct
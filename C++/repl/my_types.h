@@ -1,12 +1,27 @@
 #pragma once
-#include <optional>
+#include "name_index.h"
+#include "symbols.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 namespace ct {
 
+// хеш для поиска в map со строковым ключом по string_view без создания временной строки
+struct StringHash {
+  using is_transparent = void;
+
+  std::size_t operator()(std::string_view s) const {
+    return std::hash<std::string_view>{}(s);
+  }
+};
+
 // типы после парсинга схемы
 
 enum class Builtin {
@@ -17,18 +32,26 @@ enum class Builtin {
   String
 };
 
-// это класс обёртка над каждым типом в подаваемой схеме. по сути в нём хранится название тип
-// всегда будет активным только 1 optional (в комментах в пулл реквесте пояснил за это)
+// это класс обёртка над каждым типом в подаваемой схеме. весь тип - одно 32-битное число: у встроенного типа
+// выставлен старший бит, а в младших лежит Builtin, у пользовательского - Symbol его имени
 struct Type {
-  std::optional<Builtin> builtin;
-  std::optional<std::string> user;
+  static constexpr uint32_t BUILTIN_TAG = 1u << 31;
+
+  uint32_t bits = BUILTIN_TAG;
 
   static Type builtin_of(Builtin b);
 
+  // интернирует имя в Symbols
   static Type user_of(std::string_view b);
+  static Type user_of(Symbol s);
   std::string str() const;
 
   bool is_builtin() const;
+  Builtin builtin() const;
+  Symbol user() const;
+  std::string_view user_name() const;
+
+  bool operator==(const Type&) const = default;
 };
 
 struct Field {
@@ -36,9 +59,46 @@ struct Field {
   Type type;
 };
 
+struct Struct;
+
+// одна операция скомпилированного плана (codec_plan.h): примитив или значение структуры. поля структуры не
+// разворачиваются в план функции, а лежат один раз в её собственном плане Struct::plan, так что размер всех планов
+// линеен по размеру схемы, как бы глубоко ни были вложены структуры
+enum class PlanOpKind {
+  Builtin,
+  Struct
+};
+
+struct PlanOp {
+  PlanOpKind kind;
+  Builtin builtin = Builtin::Int32;
+  // структура для PlanOpKind::Struct, её поля - st->plan
+  const Struct* st = nullptr;
+  // имя аргумента или поля, значение которого обрабатывает операция. у возвращаемого значения - nullptr
+  const std::string* name = nullptr;
+  // готовый текст, который десериализатор печатает перед значением: ", name=", "Point{" и т.п. после полей
+  // структуры он сам печатает "}"
+  std::string prefix;
+  // для полей структуры - позиция поля в Struct::fields
+  uint32_t field = 0;
+};
+
 struct Struct {
   std::string name;
   std::vector<Field> fields;
+  // имя поля -> его позиция в fields, заполняется compile_plans
+  std::unordered_map<std::string, uint32_t, StringHash, std::equal_to<>> field_index;
+  // по операции на поле в порядке fields, заполняется compile_plans. вложенная структура - одна операция со ссылкой
+  // на неё
+  std::vector<PlanOp> plan;
+
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  // имена полей -> позиция в fields для автодополнения, заполняется build_completion_index
+  NameIndex<uint32_t> field_names;
+
+  // позиция поля или npos
+  std::size_t find_field(std::string_view n) const;
 };
 
 struct Arg {
@@ -46,18 +106,76 @@ struct Arg {
   Type type;
 };
 
+struct CodecPlan {
+  // аргументы функции в порядке схемы
+  std::vector<PlanOp> args;
+  // возвращаемое значение
+  std::vector<PlanOp> ret;
+  // XXH64 от формы ret (виды операций, примитивы, имена структур и полей). у функции с тем же именем и аргументами
+  // после перезагрузки схемы он меняется, если поменялся ответ, - так ResponseCache не отдаёт ответ старой формы
+  uint64_t ret_shape = 0;
+};
+
 struct Function {
   std::string name;
   Type return_type;
   std::vector<Arg> args;
+  // XXH32 от имени - id функции на проводе, считается один раз при разборе схемы
+  uint32_t id = 0;
+  // fn name -> T pure { ... }: функция только читает, одинаковые запросы получают одинаковые ответы, так что ответ
+  // можно брать из ResponseCache (response_cache.h)
+  bool pure = false;
+  // заполняется compile_plans при загрузке схемы и ссылается на структуры этой же схемы
+  CodecPlan plan;
+  // имена аргументов -> позиция в args, заполняется build_completion_index
+  NameIndex<uint32_t> arg_names;
+};
+
+uint32_t function_id(std::string_view name);
+
+// обратная таблица id -> Function: открытая адресация с линейным пробированием, заполнена не больше чем наполовину
+// функции ищутся по тексту запроса на каждой строке, поэтому ключ - строка с прозрачным хешем: find по string_view
+// без временной строки и без обращения к Symbols
+using FunctionMap = std::unordered_map<std::string, Function, StringHash, std::equal_to<>>;
+// структуры ищутся по Type, то есть по Symbol имени
+using StructMap = std::unordered_map<Symbol, Struct>;
+
+class FunctionIdTable {
+public:
+  // бросает SchemaError, если у двух функций совпал id
+  void build(const FunctionMap& functions);
+
+  const Function* find(uint32_t id) const;
+
+private:
+  std::vector<const Function*> slots_;
+  uint32_t mask_ = 0;
 };
 
 struct Schema {
-  std::unordered_map<std::string, Struct> structs;
-  std::unordered_map<std::string, Function> functions;
+  StructMap structs;
+  FunctionMap functions;
+  // указывает внутрь functions, строится в parse_schema_text
+  FunctionIdTable by_id;
+  // имена функций для автодополнения, заполняется build_completion_index
+  NameIndex<const Function*> function_names;
+  // пути из import "..." в порядке появления, как записаны в тексте. заполняется parse_schema_fragment,
+  // load_schema_file разворачивает их и очищает
+  std::vector<std::string> imports;
+
+  // by_id и function_names смотрят внутрь functions: копия указывала бы в чужую схему, а перенос узлы не трогает
+  Schema() = default;
+  Schema(const Schema&) = delete;
+  Schema& operator=(const Schema&) = delete;
+  Schema(Schema&&) = default;
+  Schema& operator=(Schema&&) = default;
 
+  const Struct* find_struct(Symbol s) const;
+  // nullptr и для встроенного типа
+  const Struct* find_struct(Type t) const;
   const Struct* find_struct(std::string_view n) const;
   const Function* find_function(std::string_view n) const;
+  const Function* find_function_by_id(uint32_t id) const;
 };
 
 struct SchemaError : std::runtime_error {
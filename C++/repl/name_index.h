@@ -0,0 +1,48 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ct {
+
+// отсортированный массив имён для поиска по префиксу. имена с общим префиксом в нём идут подряд, поэтому весь
+// диапазон находится двумя бинарными поисками, которые сравнивают только первые prefix.size() символов.
+// сами строки не копируются - string_view ссылаются на имена в схеме
+template <typename T>
+class NameIndex {
+public:
+  struct Entry {
+    std::string_view name;
+    T value;
+  };
+
+  void build(std::vector<Entry> entries) {
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+    entries_ = std::move(entries);
+  }
+
+  // [first, last) - позиции всех имён, начинающихся с prefix, в порядке возрастания имён
+  std::pair<std::size_t, std::size_t> range(std::string_view prefix) const {
+    auto head = [&](const Entry& e) { return e.name.substr(0, prefix.size()); };
+    auto first = std::partition_point(entries_.begin(), entries_.end(), [&](const Entry& e) {
+      return head(e) < prefix;
+    });
+    auto last = std::partition_point(first, entries_.end(), [&](const Entry& e) { return head(e) == prefix; });
+    return {static_cast<std::size_t>(first - entries_.begin()), static_cast<std::size_t>(last - entries_.begin())};
+  }
+
+  const Entry& operator[](std::size_t k) const {
+    return entries_[k];
+  }
+
+  std::size_t size() const {
+    return entries_.size();
+  }
+
+private:
+  std::vector<Entry> entries_;
+};
+
+} // namespace ct
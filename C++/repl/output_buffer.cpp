@@ -0,0 +1,21 @@
+#include "output_buffer.h"
+
+#include <algorithm>
+
+namespace ct {
+
+void OutputBuffer::flush(std::ostream& os) {
+  os.write(data_.data(), static_cast<std::streamsize>(size_));
+  os.flush();
+  size_ = 0;
+}
+
+char* OutputBuffer::grow(std::size_t n) {
+  if (data_.size() - size_ < n) {
+    data_.resize(std::max(data_.size() * 2, size_ + n));
+  }
+  char* dst = data_.data() + size_;
+  size_ += n;
+  return dst;
+}
+} // namespace ct
@@ -0,0 +1,68 @@
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace ct {
+
+// растущий буфер для текста ответов. память переиспользуется между строками, числа пишутся через to_chars без
+// временных std::string, а в поток буфер сбрасывается большими кусками
+class OutputBuffer {
+public:
+  static constexpr std::size_t FLUSH_THRESHOLD = 1 << 16;
+
+  void append(std::string_view s) {
+    char* dst = grow(s.size());
+    s.copy(dst, s.size());
+  }
+
+  void push_back(char c) {
+    *grow(1) = c;
+  }
+
+  template <typename T>
+  void append_int(T v) {
+    // 20 цифр максимум у uint64 + знак
+    char* dst = grow(21);
+    auto res = std::to_chars(dst, dst + 21, v);
+    size_ = res.ptr - data_.data();
+  }
+
+  std::string_view view() const {
+    return {data_.data(), size_};
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  // откатить недописанное, например, если разбор ответа упал на середине
+  void truncate(std::size_t n) {
+    if (n < size_) {
+      size_ = n;
+    }
+  }
+
+  void clear() {
+    size_ = 0;
+  }
+
+  // пишет накопленное в os и сбрасывает сам os, чтобы текст сразу ушёл читателю
+  void flush(std::ostream& os);
+
+  void flush_if_full(std::ostream& os) {
+    if (size_ >= FLUSH_THRESHOLD) {
+      flush(os);
+    }
+  }
+
+private:
+  // место под ещё n символов; size_ сразу сдвигается на n
+  char* grow(std::size_t n);
+
+  std::vector<char> data_;
+  std::size_t size_ = 0;
+};
+} // namespace ct
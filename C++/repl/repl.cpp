@@ -1,44 +1,273 @@
 #include "repl.h"
 
+#include "async_client.h"
 #include "autocomplete.h"
+#include "bounded_queue.h"
 #include "deserializer.h"
+#include "direct_encoder.h"
+#include "load_generator.h"
 #include "request_parser.h"
+#include "rpc_server.h"
 #include "rpc/client.h"
 #include "schema_loader.h"
+#include "schema_watcher.h"
+#include "send_layers.h"
 #include "serializer.h"
+#include "single_flight.h"
+#include "staged_pipeline.h"
 
+#include <chrono>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <poll.h>
 #include <replxx.hxx>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
 namespace ct {
 
-void run_no_tty(const Schema& sch, ct::rpc::Client& client) {
+void execute_line(
+    const Schema& sch,
+    ct::rpc::Client& client,
+    const std::string& line,
+    OutputBuffer& out,
+    SendLayers layers
+) {
+  thread_local std::vector<std::byte> req;
+  const Function& fn = encode_request(sch, line, req);
+  auto resp_bytes = layers.send(fn, client, req);
+  deserialize_response(fn, resp_bytes, out);
+}
+
+std::string execute_line(const Schema& sch, ct::rpc::Client& client, const std::string& line, SendLayers layers) {
+  thread_local OutputBuffer out;
+  out.clear();
+  execute_line(sch, client, line, out, layers);
+  return std::string(out.view());
+}
+
+void print_error(OutputBuffer& out, const std::runtime_error& e) {
+  out.append("Error: ");
+  out.append(e.what());
+  out.push_back('\n');
+}
+
+// есть ли следующая строка без ожидания: в буфере std::cin или уже в самом stdin. EOF тоже считается готовым вводом
+bool input_ready() {
+  if (std::cin.rdbuf()->in_avail() > 0) {
+    return true;
+  }
+  pollfd fd{STDIN_FILENO, POLLIN, 0};
+  return ::poll(&fd, 1, 0) > 0;
+}
+
+// вывод копится в буфере и уходит в stdout кусками по OutputBuffer::FLUSH_THRESHOLD, а также каждый раз, когда
+// следующей строки ещё нет: программа, которая пишет в repl по строке через pipe и ждёт ответа, иначе его не дождётся
+void run_no_tty(const SchemaHandle& sch, ct::rpc::Client& client, SendLayers layers) {
+  SchemaSnapshot snap(sch);
+  OutputBuffer out;
   std::string line;
   while (std::getline(std::cin, line)) {
+    snap.refresh();
     try {
-      auto call = RequestParser::parse(line);
-      auto req = serialize_call(sch, call);
-      auto resp_bytes = client.send(req);
-      const auto* fn = sch.find_function(call.func_name);
-      std::string out = deserialize_response_to_string(sch, *fn, resp_bytes);
-      std::cout << out << '\n';
+      execute_line(snap.get(), client, line, out, layers);
+      out.push_back('\n');
     } catch (std::runtime_error& e) {
-      std::cout << "Error: " << e.what() << '\n';
+      print_error(out, e);
+    }
+    if (input_ready()) {
+      out.flush_if_full(std::cout);
+    } else {
+      out.flush(std::cout);
     }
   }
-  std::cout << "Goodbye!" << '\n';
+  out.append("Goodbye!\n");
+  out.flush(std::cout);
 }
 
-void run_tty(const Schema& sch, ct::rpc::Client& client) {
+// окно из inflight запросов: главный поток читает строки и кладёт задачи в очередь, отправители их выполняют,
+// а печатаем всегда самый старый запрос окна. пока он не готов, новые строки не читаем - это и есть backpressure.
+// если следующей строки ещё нет, окно допечатывается и вывод сбрасывается до того, как её ждать, как в run_no_tty
+void run_no_tty_pipelined(const SchemaHandle& sch, const Options& opts, SendLayers layers) {
+  using Task = std::packaged_task<std::string(rpc::Client&)>;
+  std::size_t inflight = opts.inflight == 0 ? 1 : opts.inflight;
+
+  std::vector<std::unique_ptr<rpc::Client>> clients;
+  for (std::size_t k = 0; k < inflight; k++) {
+    clients.push_back(std::make_unique<rpc::Client>(opts.rpc_host, opts.rpc_port, opts.rpc_path));
+  }
+  BoundedQueue<Task> tasks(inflight);
+  std::vector<std::jthread> senders;
+  for (auto& client : clients) {
+    senders.emplace_back([&tasks, &client] {
+      while (auto task = tasks.pop()) {
+        (*task)(*client);
+      }
+    });
+  }
+
+  OutputBuffer out;
+  std::deque<std::future<std::string>> window;
+  auto print_oldest = [&window, &out] {
+    try {
+      out.append(window.front().get());
+      out.push_back('\n');
+    } catch (const std::runtime_error& e) {
+      print_error(out, e);
+    }
+    window.pop_front();
+    out.flush_if_full(std::cout);
+  };
+
+  SchemaSnapshot snap(sch);
+  std::string line;
+  for (;;) {
+    if (!input_ready()) {
+      while (!window.empty()) {
+        print_oldest();
+      }
+      out.flush(std::cout);
+    }
+    if (!std::getline(std::cin, line)) {
+      break;
+    }
+    if (window.size() == inflight) {
+      print_oldest();
+    }
+    snap.refresh();
+    // задача держит свою версию схемы, даже если пока она ждёт в очереди, вышла новая
+    Task task([sch = snap.share(), line = std::move(line), layers](rpc::Client& client) {
+      return execute_line(*sch, client, line, layers);
+    });
+    window.push_back(task.get_future());
+    tasks.push(std::move(task));
+  }
+  while (!window.empty()) {
+    print_oldest();
+  }
+  tasks.close();
+  senders.clear();
+  out.append("Goodbye!\n");
+  out.flush(std::cout);
+}
+
+void run_no_tty_async(const SchemaHandle& sch, const Options& opts, SendLayers layers) {
+  // запрос держит свою версию схемы до разбора ответа; ошибка кодирования ждёт своей очереди на печать в error.
+  // промах по кешу помнит байты запроса, чтобы положить ответ в cache, когда он придёт
+  struct Slot {
+    std::shared_ptr<const Schema> sch;
+    const Function* fn = nullptr;
+    std::shared_future<AsyncClient::Response> resp{};
+    std::string error{};
+    std::optional<std::vector<std::byte>> cache_key{};
+  };
+  std::size_t inflight = opts.inflight == 0 ? 1 : opts.inflight;
+  ResponseCache* cache = layers.cache;
+
+  std::optional<AsyncClient> client;
+  try {
+    client.emplace(AsyncClientOptions{
+        opts.rpc_host,
+        opts.rpc_port,
+        opts.rpc_path,
+        opts.connections,
+        std::chrono::milliseconds(opts.timeout_ms),
+    });
+  } catch (const RpcError& e) {
+    std::cerr << "Error: " << e.what() << '\n';
+    std::exit(1);
+  }
+
+  OutputBuffer out;
+  std::deque<Slot> window;
+  auto print_oldest = [&window, &out, cache] {
+    Slot& slot = window.front();
+    try {
+      if (!slot.error.empty()) {
+        throw std::runtime_error(slot.error);
+      }
+      AsyncClient::Response resp = slot.resp.get();
+      if (slot.cache_key) {
+        cache->store(*slot.fn, *slot.cache_key, resp);
+      }
+      deserialize_response(*slot.fn, resp, out);
+      out.push_back('\n');
+    } catch (const std::runtime_error& e) {
+      print_error(out, e);
+    }
+    window.pop_front();
+    out.flush_if_full(std::cout);
+  };
+
+  SchemaSnapshot snap(sch);
+  std::vector<std::byte> req;
+  std::string line;
+  for (;;) {
+    // как в run_no_tty_pipelined: без готовой строки допечатываем окно, прежде чем её ждать
+    if (!input_ready()) {
+      while (!window.empty()) {
+        print_oldest();
+      }
+      out.flush(std::cout);
+    }
+    if (!std::getline(std::cin, line)) {
+      break;
+    }
+    if (window.size() == inflight) {
+      print_oldest();
+    }
+    snap.refresh();
+    Slot slot{snap.share()};
+    try {
+      slot.fn = &encode_request(*slot.sch, line, req);
+      std::optional<std::vector<std::byte>> hit;
+      if (cache && slot.fn->pure) {
+        hit = cache->find(*slot.fn, req);
+        if (!hit) {
+          slot.cache_key = req;
+        }
+      }
+      if (hit) {
+        std::promise<AsyncClient::Response> ready;
+        ready.set_value(std::move(*hit));
+        slot.resp = ready.get_future().share();
+      } else if (layers.flight) {
+        slot.resp = layers.flight->send(*client, req);
+      } else {
+        slot.resp = client->send(req).response.share();
+      }
+    } catch (const std::runtime_error& e) {
+      slot.error = e.what();
+    }
+    window.push_back(std::move(slot));
+  }
+  while (!window.empty()) {
+    print_oldest();
+  }
+  out.append("Goodbye!\n");
+  out.flush(std::cout);
+}
+
+void run_tty(const SchemaHandle& handle, ct::rpc::Client& client, SendLayers layers) {
+  RequestArena arena;
+  SchemaSnapshot snap(handle);
+  // снимки Completer ссылаются на схему, поэтому с новой версией он создаётся заново
+  std::optional<Completer> completer(std::in_place, snap.get());
   replxx::Replxx rx;
   rx.set_max_history_size(1000);
   rx.bind_key(replxx::Replxx::KEY::TAB, [&](char32_t) {
+    if (snap.refresh()) {
+      completer.emplace(snap.get());
+    }
     auto state = rx.get_state();
     std::string input(state.text());
-    std::string completed = autocomplete(input, sch);
+    std::string completed = completer->complete(input);
     rx.set_state({completed.c_str(), static_cast<int32_t>(completed.size())});
     return replxx::Replxx::ACTION_RESULT::CONTINUE;
   });
@@ -57,14 +286,19 @@ void run_tty(const Schema& sch, ct::rpc::Client& client) {
       std::cout << "Goodbye!" << '\n';
       break;
     }
+    arena.reset();
+    if (snap.refresh()) {
+      completer.emplace(snap.get());
+    }
+    const Schema& sch = snap.get();
     try {
-      auto call = RequestParser::parse(line);
-      auto req = serialize_call(sch, call);
-      auto resp_bytes = client.send(req);
+      auto call = RequestParser::parse(sch, line, arena.resource());
+      auto req = serialize_call(sch, call, arena.resource());
       const auto* fn = sch.find_function(call.func_name);
       if (!fn) {
         throw std::runtime_error("Unknown function");
       }
+      auto resp_bytes = layers.send(*fn, client, req);
       std::string out = deserialize_response_to_string(sch, *fn, resp_bytes);
       std::cout << out << '\n';
     } catch (const std::runtime_error& e) {
@@ -73,20 +307,89 @@ void run_tty(const Schema& sch, ct::rpc::Client& client) {
   }
 }
 
+// в stderr, чтобы не смешивать с ответами в stdout
+void print_cache_stats(const ResponseCacheStats& st) {
+  std::cerr << "Cache: " << st.hits << " hits, " << st.misses << " misses, " << st.evictions << " evicted, "
+            << st.expirations << " expired, " << st.entries << " entries, " << st.bytes << " bytes\n";
+}
+
+void print_single_flight_stats(const SingleFlightStats& st) {
+  std::cerr << "Coalesced: " << st.joined << " of " << st.sent + st.joined << " requests joined an in-flight call\n";
+}
+
+void run_stand_in(const SchemaHandle& sch, const Options& opts) {
+  HandlerRegistry registry(sch.load(), opts.load.seed, opts.load.gen);
+  try {
+    Server server(registry, {opts.rpc_host, opts.rpc_port, opts.rpc_path});
+    std::cerr << "Listening on " << opts.rpc_host << ':' << server.port() << '\n';
+    server.run();
+  } catch (const ServerError& e) {
+    std::cerr << "Error: " << e.what() << '\n';
+    std::exit(1);
+  }
+}
+
 void run(const Options& opts) {
-  Schema schema;
+  // автоответчик строит ответы по схеме, взятой один раз при старте (run_stand_in), перезагрузку он бы не увидел
+  if (opts.serve && opts.watch_schema) {
+    std::cerr << "Error: --watch-schema is not supported with --serve\n";
+    std::exit(1);
+  }
+  std::shared_ptr<const Schema> loaded;
+  std::vector<std::string> files;
   try {
-    schema = load_schema_file(opts.schema_path);
+    loaded = std::make_shared<const Schema>(load_schema_file(opts.schema_path, &files));
   } catch (const std::runtime_error& e) {
     std::cerr << "Error: " << e.what() << '\n';
     std::exit(1);
   }
+  SchemaHandle schema(std::move(loaded));
+  std::optional<SchemaWatcher> watcher;
+  if (opts.watch_schema) {
+    try {
+      watcher.emplace(opts.schema_path, files, schema);
+    } catch (const std::runtime_error& e) {
+      std::cerr << "Error: " << e.what() << '\n';
+      std::exit(1);
+    }
+  }
 
-  rpc::Client client(opts.rpc_host, opts.rpc_port, opts.rpc_path);
-  if (opts.no_tty) {
-    run_no_tty(schema, client);
+  if (opts.serve) {
+    run_stand_in(schema, opts);
+    return;
+  }
+  if (opts.loadgen) {
+    run_load_generator(schema, opts);
+    return;
+  }
+  std::optional<ResponseCache> cache;
+  if (opts.cache_bytes > 0) {
+    cache.emplace(ResponseCacheOptions{opts.cache_bytes, std::chrono::milliseconds(opts.cache_ttl_ms)});
+  }
+  std::optional<SingleFlight> flight;
+  if (opts.coalesce) {
+    flight.emplace();
+  }
+  SendLayers layers{cache ? &*cache : nullptr, flight ? &*flight : nullptr};
+  if (opts.no_tty && opts.workers > 0) {
+    run_no_tty_staged(schema, opts, layers);
+  } else if (opts.no_tty && opts.connections > 0) {
+    run_no_tty_async(schema, opts, layers);
+  } else if (opts.no_tty && opts.inflight > 1) {
+    run_no_tty_pipelined(schema, opts, layers);
   } else {
-    run_tty(schema, client);
+    rpc::Client client(opts.rpc_host, opts.rpc_port, opts.rpc_path);
+    if (opts.no_tty) {
+      run_no_tty(schema, client, layers);
+    } else {
+      run_tty(schema, client, layers);
+    }
+  }
+  if (cache) {
+    print_cache_stats(cache->stats());
+  }
+  if (flight) {
+    print_single_flight_stats(flight->stats());
   }
 }
 } // namespace ct
@@ -1,22 +1,97 @@
 #pragma once
 #include "deserializer.h"
+#include "send_layers.h"
 #include "rpc/client.h"
+#include "schema_handle.h"
+#include "value_gen.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace ct {
 
+// настройки --loadgen (load_generator.h)
+struct LoadOptions {
+  // --fn NAME, можно несколько раз: какие функции вызывать, выбираются равновероятно. пусто - все функции схемы
+  std::vector<std::string> functions;
+  // --rate R: запросов в секунду
+  double rate = 100;
+  // --duration S: сколько секунд держать нагрузку
+  double duration = 10;
+  // --seed N: при одном seed генерируется одна и та же последовательность запросов
+  uint64_t seed = 1;
+  // --str-dist uniform|exp, --min-str, --max-str, --mean-str
+  GenOptions gen;
+};
+
 struct Options {
   std::string schema_path;
   bool no_tty = false;
   std::string rpc_host = "127.0.0.1";
   int rpc_port = 8080;
   std::string rpc_path;
+  // --inflight N: сколько запросов no-tty режим держит в полёте одновременно (1 - строго по очереди)
+  std::size_t inflight = 1;
+  // --workers N: если > 0, no-tty идёт через многопоточный конвейер (staged_pipeline.h), N потоков на парсинг и
+  // столько же на разбор ответов
+  std::size_t workers = 0;
+  // --connections N: если > 0, no-tty шлёт запросы через AsyncClient (async_client.h) по N постоянным соединениям,
+  // держа в полёте до opts.inflight запросов без потока на каждый
+  std::size_t connections = 0;
+  // --timeout-ms T: таймаут одного запроса в режиме --connections, 0 - без таймаута
+  uint64_t timeout_ms = 0;
+  // --cache-bytes N: если > 0, ответы pure-функций берутся из ResponseCache (response_cache.h) с таким бюджетом,
+  // а счётчики попаданий печатаются в stderr при выходе
+  std::size_t cache_bytes = 0;
+  // --cache-ttl-ms T: сколько живёт ответ в кеше, 0 - пока не вытеснят
+  uint64_t cache_ttl_ms = 60000;
+  // --coalesce: одинаковые запросы в полёте делят одну отправку (single_flight.h). сколько запросов так склеилось,
+  // печатается в stderr при выходе
+  bool coalesce = false;
+  // --watch-schema: перечитывать схему при изменении файла, не перезапуская repl (schema_watcher.h)
+  bool watch_schema = false;
+  // --loadgen: вместо чтения строк слать случайные запросы по схеме с постоянной частотой и печатать задержки.
+  // отправителей opts.inflight, у каждого своё соединение
+  bool loadgen = false;
+  LoadOptions load;
+  // --serve: вместо клиента поднять на rpc_host:rpc_port локальную заглушку сервера (rpc_server.h), которая отвечает
+  // на все функции схемы автоответчиком. seed и длины строк берутся из load. схема берётся один раз при старте,
+  // поэтому вместе с --watch-schema не работает: run выходит с ошибкой
+  bool serve = false;
 };
 
-void run_no_tty(const Schema& sch, ct::rpc::Client& client);
+// одна строка запроса целиком: парсинг, сериализация, отправка и разбор ответа
+std::string
+execute_line(const Schema& sch, ct::rpc::Client& client, const std::string& line, SendLayers layers = {});
+
+// то же, но текст ответа дописывается в out без промежуточной строки
+void execute_line(
+    const Schema& sch,
+    ct::rpc::Client& client,
+    const std::string& line,
+    OutputBuffer& out,
+    SendLayers layers = {}
+);
+
+// run_* берут схему из handle заново на каждую строку, так что подхватывают перезагруженную версию.
+// одна строка целиком обрабатывается одной версией. запросы уходят через layers (send_layers.h)
+void run_no_tty(const SchemaHandle& sch, ct::rpc::Client& client, SendLayers layers = {});
+
+// то же, что run_no_tty, но держит до opts.inflight запросов в полёте, у каждого отправителя своё соединение.
+// ответы печатаются строго в порядке входных строк
+void run_no_tty_pipelined(const SchemaHandle& sch, const Options& opts, SendLayers layers = {});
+
+// окно как в run_no_tty_pipelined, но запросы уходят через один AsyncClient с opts.connections соединениями, так что
+// opts.inflight может быть в сотни запросов. cache и flight из layers работают так же, как в остальных режимах
+void run_no_tty_async(const SchemaHandle& sch, const Options& opts, SendLayers layers = {});
+
+void run_tty(const SchemaHandle& sch, ct::rpc::Client& client, SendLayers layers = {});
 
-void run_tty(const Schema& sch, ct::rpc::Client& client);
+// --serve: заглушка сервера с автоответчиком на opts.rpc_host:opts.rpc_port, работает до завершения процесса.
+// отвечает по версии схемы, которая была в sch при вызове, более поздние публикации не видит
+void run_stand_in(const SchemaHandle& sch, const Options& opts);
 
 void run(const Options& opts);
 } // namespace ct
@@ -1,25 +1,38 @@
 #pragma once
+#include "my_types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 
 namespace ct {
 
-// типы после парсинга запроса
+// типы после парсинга запроса. все строки и контейнеры - std::pmr, так что дерево запроса целиком можно брать
+// из RequestArena и выбрасывать одним сбросом арены
 struct Value;
 
 using Int = int64_t;
 using UInt = uint64_t;
 
+// значение структуры лежит по слотам: fields[k] - значение поля st->fields[k], monostate - поле не задано.
+// st == nullptr, если тип литерала не удалось привязать к схеме (неизвестная функция или аргумент, литерал на месте
+// примитива, чужое имя структуры) - тогда поля только проверены на синтаксис и не хранятся, а сериализатор всё равно
+// упадёт раньше, чем до них дойдёт
 struct StructValue {
-  std::string struct_name;
-  std::unordered_map<std::string, Value> fields;
+  std::pmr::string struct_name;
+  const Struct* st = nullptr;
+  std::pmr::vector<Value> fields;
 };
 
-struct Value : std::variant<std::string, Int, UInt, StructValue> {
-  using std::variant<std::string, Int, UInt, StructValue>::variant;
+struct Value : std::variant<std::monostate, std::pmr::string, Int, UInt, StructValue> {
+  using std::variant<std::monostate, std::pmr::string, Int, UInt, StructValue>::variant;
 
   template <typename T>
   bool is() const {
@@ -42,12 +55,37 @@ struct Value : std::variant<std::string, Int, UInt, StructValue> {
 };
 
 struct NamedArg {
-  std::string name;
+  std::pmr::string name;
   Value value;
 };
 
 struct Call {
-  std::string func_name;
-  std::vector<NamedArg> args;
+  std::pmr::string func_name;
+  std::pmr::vector<NamedArg> args;
+};
+
+// монотонная арена на один запрос: парсер и сериализатор берут из неё память кусками без malloc/free на каждый
+// узел, а между строками reset() отдаёт всё разом. первые initial байт лежат внутри самой арены.
+// арена однопоточная - в многопоточном режиме у каждого потока своя
+class RequestArena {
+public:
+  explicit RequestArena(std::size_t initial = 1 << 16)
+      : buf_(initial)
+      , res_(buf_.data(), buf_.size()) {}
+
+  RequestArena(const RequestArena&) = delete;
+  RequestArena& operator=(const RequestArena&) = delete;
+
+  std::pmr::memory_resource* resource() {
+    return &res_;
+  }
+
+  void reset() {
+    res_.release();
+  }
+
+private:
+  std::vector<std::byte> buf_;
+  std::pmr::monotonic_buffer_resource res_;
 };
 } // namespace ct
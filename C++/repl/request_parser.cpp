@@ -1,14 +1,91 @@
 #include "request_parser.h"
 
+#include <algorithm>
+#include <bit>
 #include <cctype>
 #include <climits>
+#include <cstdint>
+#include <cstring>
 #include <limits>
 #include <string>
 #include <unordered_map>
+#include <utility>
 
 namespace ct {
 
-Lexer::Lexer(std::string s)
+namespace {
+constexpr uint64_t ONES = 0x0101010101010101ULL;
+constexpr uint64_t LOWS = 0x7f7f7f7f7f7f7f7fULL;
+constexpr uint64_t HIGHS = 0x8080808080808080ULL;
+
+// 8 байт начиная с pos; за концом строки - нули
+uint64_t load8(std::string_view s, std::size_t pos) {
+  uint64_t w = 0;
+  std::memcpy(&w, s.data() + pos, std::min<std::size_t>(8, s.size() - pos));
+  return w;
+}
+
+// старший бит байта выставлен ровно у байтов из [lo, hi] (байты >= 0x80 никогда не подходят)
+uint64_t between_mask(uint64_t w, uint8_t lo, uint8_t hi) {
+  uint64_t x = w & LOWS;
+  uint64_t ge_lo = x + ONES * (0x80 - lo);
+  uint64_t le_hi = ONES * (0x80 + hi) - x;
+  return ge_lo & le_hi & ~w & HIGHS;
+}
+
+// старший бит выставлен ровно у байтов, равных c
+uint64_t eq_mask(uint64_t w, char c) {
+  uint64_t x = w ^ (ONES * static_cast<uint8_t>(c));
+  return ~(((x & LOWS) + LOWS) | x) & HIGHS;
+}
+
+std::size_t first_byte(uint64_t mask) {
+  if constexpr (std::endian::native == std::endian::little) {
+    return std::countr_zero(mask) / 8;
+  } else {
+    return std::countl_zero(mask) / 8;
+  }
+}
+
+// первая позиция, начиная с pos, где stop(слово) выставил бит, или s.size()
+template <typename Stop>
+std::size_t scan_until(std::string_view s, std::size_t pos, Stop stop) {
+  while (pos < s.size()) {
+    uint64_t m = stop(load8(s, pos));
+    if (m) {
+      return std::min(pos + first_byte(m), s.size());
+    }
+    pos += 8;
+  }
+  return s.size();
+}
+
+uint64_t space_mask(uint64_t w) {
+  return between_mask(w, '\t', '\r') | eq_mask(w, ' ');
+}
+
+uint64_t ident_mask(uint64_t w) {
+  return between_mask(w, '0', '9') | between_mask(w, 'A', 'Z') | between_mask(w, 'a', 'z') | eq_mask(w, '_');
+}
+
+uint64_t digit_mask(uint64_t w) {
+  return between_mask(w, '0', '9');
+}
+
+// k первых байт w - ascii-цифры (1 <= k <= 8), little-endian. сдвигом выкидываем лишние байты и дописываем ведущие
+// нули, потом складываем пары, четвёрки и восьмёрки цифр тремя умножениями
+uint64_t parse_digits(uint64_t w, std::size_t k) {
+  w &= 0x0f0f0f0f0f0f0f0fULL;
+  w <<= 8 * (8 - k);
+  w = (w * 10 + (w >> 8)) & 0x00ff00ff00ff00ffULL;
+  w = (w * 100 + (w >> 16)) & 0x0000ffff0000ffffULL;
+  return (w * 10000 + (w >> 32)) & 0xffffffffULL;
+}
+
+constexpr uint64_t POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+} // namespace
+
+Lexer::Lexer(std::string_view s)
     : src(s) {}
 
 bool Lexer::eof() const {
@@ -24,63 +101,74 @@ char Lexer::get() {
 }
 
 void Lexer::skip_ws() {
-  while (!eof() && std::isspace(peek())) {
-    ++i;
+  // обычно пробелов нет или он один, так что сначала дешёвая проверка
+  if (eof() || !std::isspace(static_cast<unsigned char>(src[i]))) {
+    return;
   }
+  i = scan_until(src, i, [](uint64_t w) { return ~space_mask(w) & HIGHS; });
 }
 
 // парсим слово
-std::string Lexer::ident() {
+std::string_view Lexer::ident() {
   skip_ws();
   if (!(std::isalpha(peek()) || peek() == '_')) {
     throw ParseError("Error: identifier excepted");
   }
-  std::string out;
-  while (!eof() && (std::isalnum(peek()) || peek() == '_')) {
-    out += get();
-  }
-  return out;
+  std::size_t start = i;
+  i = scan_until(src, i, [](uint64_t w) { return ~ident_mask(w) & HIGHS; });
+  return src.substr(start, i - start);
 }
 
-// парсим строковый литерал
+// парсим строковый литерал. до первой '"' или '\\' идём по 8 байт; если escape нет, копировать нечего
 
-std::string Lexer::string_lit() {
+std::string_view Lexer::string_lit() {
   skip_ws();
   if (peek() != '"') {
     throw ParseError("string literal excepted");
   }
   get();
-  std::string out;
+  auto special = [](uint64_t w) { return eq_mask(w, '"') | eq_mask(w, '\\'); };
+  std::size_t start = i;
+  i = scan_until(src, i, special);
+  if (eof() || peek() == '"') {
+    std::string_view out = src.substr(start, i - start);
+    get(); // пропускаем вторую "
+    if (eof()) {
+      throw ParseError("Error: unterminal string");
+    }
+    return out;
+  }
+  unescaped.assign(src.substr(start, i - start));
   while (!eof() && peek() != '"') {
-    char c = get();
-    if (c == '\\') {
-      if (eof()) {
-        throw ParseError("bad escape");
-      }
-      char e = get();
-      if (e == 'n') {
-        out += '\n';
-      } else if (e == 't') {
-        out += '\t';
-      } else if (e == '\\') {
-        out += '\\';
-      } else if (e == '"') {
-        out += '"';
-      } else {
-        throw ParseError(std::string("unknown escape \\") + e);
-      }
+    get(); // '\\'
+    if (eof()) {
+      throw ParseError("bad escape");
+    }
+    char e = get();
+    if (e == 'n') {
+      unescaped += '\n';
+    } else if (e == 't') {
+      unescaped += '\t';
+    } else if (e == '\\') {
+      unescaped += '\\';
+    } else if (e == '"') {
+      unescaped += '"';
     } else {
-      out += c;
+      throw ParseError(std::string("unknown escape \\") + e);
     }
+    std::size_t from = i;
+    i = scan_until(src, i, special);
+    unescaped.append(src.substr(from, i - from));
   }
   get(); // пропускаем вторую "
   if (eof()) {
     throw ParseError("Error: unterminal string");
   }
-  return out;
+  return unescaped;
 }
 
-// возвращаем variant. Если значение не влезет в int64, но влезет в uint64, то храним значение во втором поле variant
+// возвращаем variant. Если значение не влезет в int64, но влезет в uint64, то храним значение во втором поле variant.
+// цифры разбираем кусками до 8 штук: acc = acc * 10^k + кусок, с проверкой переполнения на каждом шаге
 std::variant<int64_t, uint64_t> Lexer::integer() {
   skip_ws();
   bool neg = false;
@@ -91,13 +179,29 @@ std::variant<int64_t, uint64_t> Lexer::integer() {
     throw ParseError("Error: integer excepted");
   }
   uint64_t acc = 0;
-  while (!eof() && std::isdigit(peek())) {
-    int d = get() - '0';
-    if (acc > (ULLONG_MAX - d) / 10) {
+  while (!eof()) {
+    uint64_t w = load8(src, i);
+    uint64_t stop = ~digit_mask(w) & HIGHS;
+    std::size_t k = std::min(stop ? first_byte(stop) : 8, src.size() - i);
+    if (k == 0) {
+      break;
+    }
+    uint64_t chunk;
+    if constexpr (std::endian::native == std::endian::little) {
+      chunk = parse_digits(w, k);
+    } else {
+      chunk = 0;
+      for (std::size_t d = 0; d < k; d++) {
+        chunk = chunk * 10 + (src[i + d] - '0');
+      }
+    }
+    if (__builtin_mul_overflow(acc, POW10[k], &acc) || __builtin_add_overflow(acc, chunk, &acc)) {
       throw ParseError("ULL overflow");
     }
-    acc *= 10;
-    acc += d;
+    i += k;
+    if (k < 8) {
+      break;
+    }
   }
   if (neg) {
     if (acc > LLONG_MAX + 1ULL) {
@@ -126,18 +230,27 @@ void Lexer::except(char c) {
   }
 }
 
-Call RequestParser::parse(std::string s) {
+Call RequestParser::parse(const Schema& sch, std::string_view s, std::pmr::memory_resource* mr) {
   Lexer lx(s);
-  Call call;
-  call.func_name = lx.ident();
+  Call call{std::pmr::string(lx.ident(), mr), std::pmr::vector<NamedArg>(mr)};
+  const Function* fn = sch.find_function(call.func_name);
   lx.except('(');
   lx.skip_ws();
   if (!lx.consume(')')) {
     for (;;) {
-      std::string argname = lx.ident();
+      std::pmr::string argname(lx.ident(), mr);
       lx.except('=');
-      Value val = parse_value(lx);
-      call.args.push_back({argname, val});
+      const Type* t = nullptr;
+      if (fn) {
+        for (auto& a : fn->args) {
+          if (a.name == std::string_view(argname)) {
+            t = &a.type;
+            break;
+          }
+        }
+      }
+      Value val = parse_value(lx, sch, t, mr);
+      call.args.push_back({std::move(argname), std::move(val)});
       lx.skip_ws();
       if (lx.consume(')')) {
         break;
@@ -154,14 +267,15 @@ Call RequestParser::parse(std::string s) {
   return call;
 }
 
-Value RequestParser::parse_value(Lexer& lx) {
+// значения только перемещаем: копия pmr-контейнера ушла бы в ресурс по умолчанию, мимо арены
+Value RequestParser::parse_value(Lexer& lx, const Schema& sch, const Type* t, std::pmr::memory_resource* mr) {
   lx.skip_ws();
   char c = lx.peek();
   if (c == '"') {
-    return Value{lx.string_lit()};
+    return Value{std::pmr::string(lx.string_lit(), mr)};
   }
   if (c == '{' || std::isalpha(c) || c == '_') {
-    std::string maybeName;
+    std::string_view maybeName;
     if (c != '{') {
       maybeName = lx.ident();
       lx.skip_ws();
@@ -171,15 +285,30 @@ Value RequestParser::parse_value(Lexer& lx) {
     } else {
       lx.get();
     }
-    StructValue sv;
-    sv.struct_name = maybeName;
+    StructValue sv{std::pmr::string(maybeName, mr), nullptr, std::pmr::vector<Value>(mr)};
+    const Struct* st = t ? sch.find_struct(*t) : nullptr;
+    if (st && (maybeName.empty() || maybeName == st->name)) {
+      sv.st = st;
+      sv.fields.resize(st->fields.size());
+    }
+    // поля, которых нет в схеме, не храним, но повтор и среди них - ошибка
+    std::pmr::vector<std::string_view> unknown(mr);
     lx.skip_ws();
     if (!lx.consume('}')) {
       for (;;) {
-        std::string fname = lx.ident();
+        std::string_view fname = lx.ident();
         lx.except('=');
-        Value fval = parse_value(lx);
-        if (!sv.fields.emplace(fname, fval).second) {
+        std::size_t k = sv.st ? sv.st->find_field(fname) : Struct::npos;
+        Value fval = parse_value(lx, sch, k == Struct::npos ? nullptr : &sv.st->fields[k].type, mr);
+        bool duplicate;
+        if (k != Struct::npos) {
+          duplicate = !sv.fields[k].is<std::monostate>();
+          sv.fields[k] = std::move(fval);
+        } else {
+          duplicate = std::find(unknown.begin(), unknown.end(), fname) != unknown.end();
+          unknown.push_back(fname);
+        }
+        if (duplicate) {
           throw ParseError("duplicate field in struct");
         }
         lx.skip_ws();
@@ -190,7 +319,7 @@ Value RequestParser::parse_value(Lexer& lx) {
         lx.skip_ws();
       }
     }
-    return Value(sv);
+    return Value(std::move(sv));
   }
   std::variant<int64_t, uint64_t> val = lx.integer();
   if (std::holds_alternative<int64_t>(val)) {
@@ -2,8 +2,11 @@
 #include "request_classes.h"
 
 #include <cctype>
+#include <memory_resource>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <variant>
 
 namespace ct {
 
@@ -11,13 +14,16 @@ struct ParseError : std::runtime_error {
   using std::runtime_error::runtime_error;
 };
 
-// класс-обёртка над строкой-запросом
+// класс-обёртка над строкой-запросом. строку не копирует: src должна жить, пока жив лексер и то, что он вернул.
+// пробелы, имена, содержимое строк и цифры ищутся по 8 байт за раз (SWAR)
 class Lexer {
-  std::string src;
+  std::string_view src;
   std::size_t i = 0;
+  // сюда раскрываются строковые литералы с escape-последовательностями
+  std::string unescaped;
 
 public:
-  Lexer(std::string s);
+  Lexer(std::string_view s);
 
   bool eof() const;
 
@@ -27,9 +33,11 @@ public:
 
   void skip_ws();
 
-  std::string ident();
+  // view в исходную строку
+  std::string_view ident();
 
-  std::string string_lit();
+  // если в литерале нет escape, то view в исходную строку, иначе во внутренний буфер - до следующего string_lit
+  std::string_view string_lit();
 
   std::variant<int64_t, uint64_t> integer();
 
@@ -40,9 +48,13 @@ public:
 
 class RequestParser {
 public:
-  static Call parse(std::string s);
+  // литералы структур раскладываются по слотам полей схемы (StructValue::fields), поэтому нужна sch.
+  // всё дерево запроса выделяется из mr (например, RequestArena::resource())
+  static Call
+  parse(const Schema& sch, std::string_view s, std::pmr::memory_resource* mr = std::pmr::get_default_resource());
 
 private:
-  static Value parse_value(Lexer& lx);
+  // t - ожидаемый тип значения или nullptr, если он неизвестен
+  static Value parse_value(Lexer& lx, const Schema& sch, const Type* t, std::pmr::memory_resource* mr);
 };
 } // namespace ct
@@ -0,0 +1,81 @@
+#include "response_cache.h"
+
+#include "endian.h"
+
+#include <cstring>
+
+namespace ct {
+namespace {
+
+// примерная цена записи сверх ключа и ответа: узел списка и узел хеш-таблицы
+constexpr std::size_t ENTRY_OVERHEAD = 128;
+
+void make_key(std::string& key, const Function& fn, std::span<const std::byte> req) {
+  key.resize(sizeof(uint64_t) + req.size());
+  store_be<uint64_t>(reinterpret_cast<std::byte*>(key.data()), fn.plan.ret_shape);
+  std::memcpy(key.data() + sizeof(uint64_t), req.data(), req.size());
+}
+} // namespace
+
+std::size_t ResponseCache::Entry::bytes() const {
+  return key.size() + resp.size() + ENTRY_OVERHEAD;
+}
+
+ResponseCache::ResponseCache(ResponseCacheOptions opts)
+    : opts_(opts) {}
+
+std::optional<std::vector<std::byte>> ResponseCache::find(const Function& fn, std::span<const std::byte> req) {
+  thread_local std::string key;
+  make_key(key, fn, req);
+  std::lock_guard lock(m_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    stats_.misses++;
+    return std::nullopt;
+  }
+  List::iterator entry = it->second;
+  if (opts_.ttl.count() > 0 && entry->expires <= Clock::now()) {
+    erase(entry);
+    stats_.expirations++;
+    stats_.misses++;
+    return std::nullopt;
+  }
+  lru_.splice(lru_.begin(), lru_, entry);
+  stats_.hits++;
+  return entry->resp;
+}
+
+void ResponseCache::store(const Function& fn, std::span<const std::byte> req, std::span<const std::byte> resp) {
+  Entry fresh{{}, {resp.begin(), resp.end()}, Clock::now() + opts_.ttl};
+  make_key(fresh.key, fn, req);
+  std::size_t need = fresh.bytes();
+  if (need > opts_.max_bytes) {
+    return;
+  }
+  std::lock_guard lock(m_);
+  // тот же запрос мог успеть положить другой поток - оставляем более свежий ответ
+  if (auto it = index_.find(fresh.key); it != index_.end()) {
+    erase(it->second);
+  }
+  while (stats_.bytes + need > opts_.max_bytes) {
+    erase(std::prev(lru_.end()));
+    stats_.evictions++;
+  }
+  lru_.push_front(std::move(fresh));
+  index_.emplace(lru_.front().key, lru_.begin());
+  stats_.bytes += need;
+  stats_.entries++;
+}
+
+ResponseCacheStats ResponseCache::stats() const {
+  std::lock_guard lock(m_);
+  return stats_;
+}
+
+void ResponseCache::erase(List::iterator it) {
+  stats_.bytes -= it->bytes();
+  stats_.entries--;
+  index_.erase(it->key);
+  lru_.erase(it);
+}
+} // namespace ct
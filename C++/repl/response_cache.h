@@ -0,0 +1,74 @@
+#pragma once
+#include "my_types.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ct {
+
+struct ResponseCacheOptions {
+  // сколько байт держат ключи и ответы вместе с накладными расходами на запись
+  std::size_t max_bytes = 64 << 20;
+  // сколько живёт ответ, 0 - пока не вытеснят
+  std::chrono::milliseconds ttl{60000};
+};
+
+struct ResponseCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  // вытеснено по бюджету и выброшено по ttl
+  uint64_t evictions = 0;
+  uint64_t expirations = 0;
+  std::size_t entries = 0;
+  std::size_t bytes = 0;
+};
+
+// LRU-кеш ответов pure-функций (Function::pure). ключ - форма ответа fn (CodecPlan::ret_shape) и байты запроса
+// целиком, как их пишет serialize_call, так что одинаковые вызовы совпадают без разбора, а после перезагрузки схемы,
+// поменявшей тип ответа, старые записи просто не находятся и уходят по LRU. можно звать из любых потоков
+class ResponseCache {
+public:
+  explicit ResponseCache(ResponseCacheOptions opts = {});
+
+  // ответ из кеша или nullopt. просроченная запись выбрасывается и считается промахом
+  std::optional<std::vector<std::byte>> find(const Function& fn, std::span<const std::byte> req);
+
+  // запись больше всего бюджета не кладётся
+  void store(const Function& fn, std::span<const std::byte> req, std::span<const std::byte> resp);
+
+  ResponseCacheStats stats() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    std::string key;
+    std::vector<std::byte> resp;
+    Clock::time_point expires;
+
+    std::size_t bytes() const;
+  };
+
+  using List = std::list<Entry>;
+
+  void erase(List::iterator it);
+
+  ResponseCacheOptions opts_;
+  mutable std::mutex m_;
+  // от недавно использованных к давним
+  List lru_;
+  // ключи смотрят в Entry::key, узлы списка не переезжают
+  std::unordered_map<std::string_view, List::iterator> index_;
+  ResponseCacheStats stats_;
+};
+
+} // namespace ct
@@ -0,0 +1,405 @@
+#include "rpc_server.h"
+
+#include "deserializer.h"
+#include "http.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <random>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <xxhash.h>
+
+namespace ct {
+namespace {
+
+// заголовок больше этого - не HTTP-клиент, а мусор; тело больше - не запрос по схеме
+constexpr std::size_t MAX_HEAD = 1 << 16;
+constexpr std::size_t MAX_BODY = 1 << 26;
+// через сколько снова пробовать accept после паузы, если ни одно соединение так и не закрылось
+constexpr int ACCEPT_RETRY_MS = 100;
+
+// rpc_path может быть записан и с ведущим '/', и без
+bool path_matches(std::string_view target, std::string_view path) {
+  if (path.empty()) {
+    return true;
+  }
+  if (!target.empty() && target.front() == '/') {
+    target.remove_prefix(1);
+  }
+  if (!path.empty() && path.front() == '/') {
+    path.remove_prefix(1);
+  }
+  return target == path;
+}
+
+std::span<const std::byte> text_body(std::string_view s) {
+  return std::as_bytes(std::span(s.data(), s.size()));
+}
+} // namespace
+
+HandlerRegistry::HandlerRegistry(std::shared_ptr<const Schema> sch, uint64_t seed, GenOptions gen)
+    : sch_(std::move(sch))
+    , seed_(seed)
+    , gen_(gen) {}
+
+void HandlerRegistry::add(std::string_view fn_name, Handler handler) {
+  const Function* fn = sch_->find_function(fn_name);
+  if (!fn) {
+    throw ServerError("unknown function '" + std::string(fn_name) + "'");
+  }
+  handlers_[fn->id] = std::move(handler);
+}
+
+void HandlerRegistry::dispatch(std::span<const std::byte> req, std::vector<std::byte>& resp) const {
+  Cursor cur{req.data(), req.size()};
+  const Function* fn;
+  try {
+    uint32_t id = cur.get_be<uint32_t>();
+    fn = sch_->find_function_by_id(id);
+    if (!fn) {
+      throw BadRequest("unknown function id " + std::to_string(id));
+    }
+    skip_plan(cur, fn->plan.args);
+  } catch (const DeserError& e) {
+    throw BadRequest(std::string("malformed request: ") + e.what());
+  }
+  if (cur.i != cur.n) {
+    throw BadRequest("extra bytes after arguments of '" + fn->name + "'");
+  }
+
+  resp.clear();
+  auto it = handlers_.find(fn->id);
+  if (it == handlers_.end()) {
+    std::mt19937_64 rng(XXH64(req.data(), req.size(), seed_));
+    generate_wire(fn->plan.ret, rng, gen_, resp);
+    return;
+  }
+  it->second(*fn, req.subspan(sizeof(uint32_t)), resp);
+  // ответ проверяем здесь, чтобы ошибка обработчика не превратилась в непонятную ошибку разбора на клиенте
+  Cursor out{resp.data(), resp.size()};
+  bool valid;
+  try {
+    skip_plan(out, fn->plan.ret);
+    valid = out.i == out.n;
+  } catch (const DeserError&) {
+    valid = false;
+  }
+  if (!valid) {
+    throw ServerError("handler for '" + fn->name + "' returned a malformed response");
+  }
+}
+
+struct Server::Connection {
+  int fd;
+  std::string in{};
+  std::string out{};
+  std::size_t out_pos = 0;
+  // вывод не ушёл целиком, ждём EPOLLOUT
+  bool want_write = false;
+  // дописать вывод и закрыть
+  bool closing = false;
+  // клиент закрыл свою сторону: читать больше нечего, а EPOLLIN на таком сокете готов всегда
+  bool eof = false;
+  // на что соединение сейчас подписано в epoll
+  uint32_t events = EPOLLIN | EPOLLRDHUP;
+};
+
+Server::Server(const HandlerRegistry& registry, ServerOptions opts)
+    : registry_(registry)
+    , opts_(std::move(opts)) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  addrinfo* addrs = nullptr;
+  std::string port = std::to_string(opts_.port);
+  int rc = ::getaddrinfo(opts_.host.empty() ? nullptr : opts_.host.c_str(), port.c_str(), &hints, &addrs);
+  if (rc != 0) {
+    throw ServerError("Cannot resolve " + opts_.host + ": " + ::gai_strerror(rc));
+  }
+  int err = 0;
+  for (addrinfo* a = addrs; a && listen_fd_ < 0; a = a->ai_next) {
+    int fd = ::socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, a->ai_protocol);
+    if (fd < 0) {
+      err = errno;
+      continue;
+    }
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::bind(fd, a->ai_addr, a->ai_addrlen) < 0 || ::listen(fd, SOMAXCONN) < 0) {
+      err = errno;
+      ::close(fd);
+      continue;
+    }
+    listen_fd_ = fd;
+  }
+  ::freeaddrinfo(addrs);
+  if (listen_fd_ < 0) {
+    throw ServerError("Cannot listen on " + opts_.host + ":" + port + ": " + std::strerror(err));
+  }
+
+  sockaddr_storage bound{};
+  socklen_t len = sizeof(bound);
+  ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&bound), &len);
+  port_ = ntohs(
+      bound.ss_family == AF_INET6 ? reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port
+                                  : reinterpret_cast<sockaddr_in*>(&bound)->sin_port
+  );
+
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  stop_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || stop_fd_ < 0) {
+    err = errno;
+    ::close(listen_fd_);
+    if (epoll_fd_ >= 0) {
+      ::close(epoll_fd_);
+    }
+    throw ServerError(std::string("Cannot start server: ") + std::strerror(err));
+  }
+  for (int fd : {listen_fd_, stop_fd_}) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+Server::~Server() {
+  for (auto& [fd, conn] : connections_) {
+    ::close(fd);
+  }
+  ::close(stop_fd_);
+  ::close(epoll_fd_);
+  ::close(listen_fd_);
+}
+
+void Server::stop() {
+  uint64_t one = 1;
+  [[maybe_unused]] auto n = ::write(stop_fd_, &one, sizeof(one));
+}
+
+void Server::run() {
+  epoll_event events[64];
+  for (;;) {
+    int n = ::epoll_wait(epoll_fd_, events, 64, accept_paused_ ? ACCEPT_RETRY_MS : -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw ServerError(std::string("epoll_wait: ") + std::strerror(errno));
+    }
+    if (accept_paused_) {
+      resume_accept();
+    }
+    for (int k = 0; k < n; k++) {
+      int fd = events[k].data.fd;
+      if (fd == stop_fd_) {
+        uint64_t value;
+        [[maybe_unused]] auto r = ::read(stop_fd_, &value, sizeof(value));
+        return;
+      }
+      if (fd == listen_fd_) {
+        accept_all();
+        continue;
+      }
+      auto it = connections_.find(fd);
+      if (it == connections_.end()) {
+        continue;
+      }
+      Connection& conn = *it->second;
+      uint32_t ev = events[k].events;
+      bool ok = !(ev & EPOLLERR);
+      if (ok && (ev & (EPOLLIN | EPOLLHUP | EPOLLRDHUP))) {
+        ok = on_readable(conn);
+      }
+      if (ok && (ev & EPOLLOUT)) {
+        ok = flush(conn);
+      }
+      if (!ok) {
+        close_connection(fd);
+      }
+    }
+  }
+}
+
+void Server::accept_all() {
+  for (;;) {
+    int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      // EAGAIN - очередь разобрана. остальное (кончились дескрипторы, память) само не пройдёт, а слушающий сокет так
+      // и останется готовым - снимаем его с epoll, клиенты пока подождут в очереди listen
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_fd_, nullptr);
+        accept_paused_ = true;
+      }
+      return;
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      ::close(fd);
+      continue;
+    }
+    connections_.emplace(fd, std::make_unique<Connection>(Connection{fd}));
+  }
+}
+
+bool Server::on_readable(Connection& conn) {
+  bool eof = false;
+  char buf[1 << 16];
+  for (;;) {
+    ssize_t n = ::recv(conn.fd, buf, sizeof(buf), 0);
+    if (n > 0) {
+      conn.in.append(buf, static_cast<std::size_t>(n));
+      continue;
+    }
+    if (n == 0) {
+      eof = true;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return false;
+    }
+    break;
+  }
+  if (!conn.closing) {
+    handle_requests(conn);
+  } else {
+    // ответов больше не будет, а копить то, что клиент ещё шлёт, незачем
+    conn.in.clear();
+  }
+  // клиент закрыл свою сторону: дописываем ответы на то, что уже пришло, и закрываем. чтение снимаем, иначе
+  // epoll будет будить нас на этом сокете, пока медленный клиент не заберёт ответы
+  if (eof) {
+    conn.closing = true;
+    conn.eof = true;
+  }
+  return flush(conn);
+}
+
+// в буфере может лежать сразу несколько запросов - отвечаем на все целиком пришедшие
+void Server::handle_requests(Connection& conn) {
+  std::size_t pos = 0;
+  while (!conn.closing) {
+    std::string_view rest = std::string_view(conn.in).substr(pos);
+    std::optional<HttpHead> head;
+    try {
+      head = parse_http_head(rest, MAX_HEAD, MAX_BODY);
+    } catch (const HttpError& e) {
+      conn.closing = true;
+      respond(conn, 400, "Bad Request", text_body(e.what()));
+      break;
+    }
+    if (!head || rest.size() - head->size < head->content_length) {
+      break;
+    }
+    conn.closing = head->connection_close.value_or(head->third == "HTTP/1.0");
+    auto body = text_body(rest.substr(head->size, head->content_length));
+    pos += head->size + head->content_length;
+    if (head->first != "POST") {
+      respond(conn, 405, "Method Not Allowed", {});
+      continue;
+    }
+    if (!path_matches(head->second, opts_.path)) {
+      respond(conn, 404, "Not Found", {});
+      continue;
+    }
+    try {
+      registry_.dispatch(body, resp_);
+      respond(conn, 200, "OK", resp_);
+    } catch (const BadRequest& e) {
+      respond(conn, 400, "Bad Request", text_body(e.what()));
+    } catch (const std::exception& e) {
+      respond(conn, 500, "Internal Server Error", text_body(e.what()));
+    }
+  }
+  conn.in.erase(0, pos);
+}
+
+void Server::respond(Connection& conn, int status, std::string_view reason, std::span<const std::byte> body) {
+  std::string& out = conn.out;
+  out += "HTTP/1.1 ";
+  out += std::to_string(status);
+  out += ' ';
+  out += reason;
+  out += "\r\nContent-Type: application/octet-stream\r\nContent-Length: ";
+  out += std::to_string(body.size());
+  if (conn.closing) {
+    out += "\r\nConnection: close";
+  }
+  out += "\r\n\r\n";
+  out.append(reinterpret_cast<const char*>(body.data()), body.size());
+}
+
+bool Server::flush(Connection& conn) {
+  while (conn.out_pos < conn.out.size()) {
+    ssize_t n = ::send(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos, MSG_NOSIGNAL);
+    if (n >= 0) {
+      conn.out_pos += static_cast<std::size_t>(n);
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return false;
+    }
+    // сокет переполнен: допишем, когда epoll скажет, что можно
+    conn.want_write = true;
+    watch(conn);
+    return true;
+  }
+  conn.out.clear();
+  conn.out_pos = 0;
+  conn.want_write = false;
+  if (conn.closing) {
+    return false;
+  }
+  watch(conn);
+  return true;
+}
+
+void Server::watch(Connection& conn) {
+  uint32_t events = (conn.eof ? 0 : EPOLLIN | EPOLLRDHUP) | (conn.want_write ? EPOLLOUT : 0u);
+  if (events == conn.events) {
+    return;
+  }
+  epoll_event ev{};
+  ev.events = events;
+  ev.data.fd = conn.fd;
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &ev);
+  conn.events = events;
+}
+
+void Server::resume_accept() {
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = listen_fd_;
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+  accept_paused_ = false;
+}
+
+void Server::close_connection(int fd) {
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  ::close(fd);
+  connections_.erase(fd);
+  // освободился дескриптор - можно снова принимать
+  if (accept_paused_) {
+    resume_accept();
+  }
+}
+} // namespace ct
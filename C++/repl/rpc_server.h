@@ -0,0 +1,120 @@
+#pragma once
+#include "my_types.h"
+#include "value_gen.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ct {
+
+struct ServerError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// запрос не разбирается по схеме: неизвестный id функции, аргументы не сходятся с планом
+struct BadRequest : ServerError {
+  using ServerError::ServerError;
+};
+
+// разбор запросов на стороне сервера: тело запроса - тот же формат, что пишет serialize_call (XXH32 id функции и
+// аргументы по Function::plan.args), ответ - значение по Function::plan.ret, как его читает deserialize_response.
+// функции без своего обработчика отвечает автоответчик: случайное значение возвращаемого типа (generate_wire).
+// генератор инициализируется хешем запроса, так что одинаковые запросы всегда получают одинаковые ответы.
+// после построения реестр только читается, поэтому dispatch можно звать из любых потоков
+class HandlerRegistry {
+public:
+  // args - аргументы без id функции, уже проверенные по плану; ответ дописывается в resp
+  using Handler =
+      std::function<void(const Function& fn, std::span<const std::byte> args, std::vector<std::byte>& resp)>;
+
+  explicit HandlerRegistry(std::shared_ptr<const Schema> sch, uint64_t seed = 1, GenOptions gen = {});
+
+  // бросает ServerError, если такой функции в схеме нет
+  void add(std::string_view fn_name, Handler handler);
+
+  // ответ на запрос целиком. бросает BadRequest на битый запрос; ответ обработчика, не подходящий под план, -
+  // ServerError
+  void dispatch(std::span<const std::byte> req, std::vector<std::byte>& resp) const;
+
+  const Schema& schema() const {
+    return *sch_;
+  }
+
+private:
+  std::shared_ptr<const Schema> sch_;
+  std::unordered_map<uint32_t, Handler> handlers_;
+  uint64_t seed_;
+  GenOptions gen_;
+};
+
+struct ServerOptions {
+  std::string host = "127.0.0.1";
+  // 0 - любой свободный порт, его потом отдаёт Server::port()
+  int port = 8080;
+  // путь, на который клиент шлёт POST; пустой - принимаем любой
+  std::string path;
+};
+
+// локальная заглушка rpc-сервера для нагрузочных прогонов и CI. один поток с epoll обслуживает сколько угодно
+// соединений: сокеты неблокирующие, у каждого соединения свои буферы ввода и вывода, запросы внутри одного
+// соединения могут идти подряд без ожидания ответа (keep-alive, pipelining).
+// кадрирование - HTTP/1.1 POST с Content-Length, как ходит rpc::Client на rpc_host:rpc_port/rpc_path; тело запроса и
+// ответа - байты как есть. битый запрос получает 400, упавший обработчик - 500, чужой путь - 404
+class Server {
+public:
+  // открывает и слушает сокет; бросает ServerError, если не вышло
+  Server(const HandlerRegistry& registry, ServerOptions opts);
+  ~Server();
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  int port() const {
+    return port_;
+  }
+
+  // обслуживает соединения, пока не позовут stop()
+  void run();
+
+  // можно звать из любого потока и из обработчика
+  void stop();
+
+private:
+  struct Connection;
+
+  void accept_all();
+  // снова слушать сокет после паузы в accept_all
+  void resume_accept();
+  // on_readable и flush возвращают false, если соединение надо закрыть
+  bool on_readable(Connection& conn);
+  bool flush(Connection& conn);
+  void handle_requests(Connection& conn);
+  void respond(Connection& conn, int status, std::string_view reason, std::span<const std::byte> body);
+  void close_connection(int fd);
+  // подписка соединения на epoll по его состоянию: чтение, пока клиент не закрыл свою сторону, запись, пока вывод
+  // не ушёл целиком
+  void watch(Connection& conn);
+
+  const HandlerRegistry& registry_;
+  ServerOptions opts_;
+  int listen_fd_ = -1;
+  int epoll_fd_ = -1;
+  // eventfd, через который stop() будит run()
+  int stop_fd_ = -1;
+  int port_ = 0;
+  // accept упал не на EAGAIN (например, кончились дескрипторы): слушающий сокет снят с epoll, чтобы готовый в нём
+  // запрос не крутил цикл вхолостую. возвращается, когда закрывается соединение или истекает ACCEPT_RETRY
+  bool accept_paused_ = false;
+  std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+  std::vector<std::byte> resp_;
+};
+
+} // namespace ct
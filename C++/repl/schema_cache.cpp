@@ -0,0 +1,234 @@
+#include "schema_cache.h"
+
+#include "deserializer.h"
+#include "endian.h"
+#include "mapped_file.h"
+
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <xxhash.h>
+
+namespace ct {
+namespace {
+
+constexpr uint32_t CACHE_MAGIC = 0x43544353; // "CTCS"
+constexpr uint32_t CACHE_VERSION = 3;
+
+void put_string(std::vector<std::byte>& out, std::string_view s) {
+  put_be<uint32_t>(out, static_cast<uint32_t>(s.size()));
+  put_bytes(out, std::as_bytes(std::span(s.data(), s.size())));
+}
+
+// встроенный тип пишется как есть (Type::bits со старшим битом), пользовательский - номером имени в таблице имён файла
+void put_type(std::vector<std::byte>& out, Type t, const std::unordered_map<Symbol, uint32_t>& index) {
+  put_be<uint32_t>(out, t.is_builtin() ? t.bits : index.at(t.user()));
+}
+
+// таблица имён: сначала структуры этого файла, потом типы, на которые он ссылается, но которые объявлены в других
+// файлах (import)
+std::vector<Symbol> name_table(const Schema& sch) {
+  std::vector<Symbol> names;
+  std::unordered_map<Symbol, uint32_t> seen;
+  auto add = [&](Type t) {
+    if (!t.is_builtin() && seen.emplace(t.user(), static_cast<uint32_t>(names.size())).second) {
+      names.push_back(t.user());
+    }
+  };
+  for (auto& [sym, _] : sch.structs) {
+    add(Type::user_of(sym));
+  }
+  for (auto& [_, st] : sch.structs) {
+    for (auto& f : st.fields) {
+      add(f.type);
+    }
+  }
+  for (auto& [_, fn] : sch.functions) {
+    add(fn.return_type);
+    for (auto& a : fn.args) {
+      add(a.type);
+    }
+  }
+  return names;
+}
+
+std::vector<std::byte> encode(uint64_t hash, const Schema& sch) {
+  std::vector<Symbol> names = name_table(sch);
+  std::unordered_map<Symbol, uint32_t> index;
+  for (Symbol sym : names) {
+    index.emplace(sym, static_cast<uint32_t>(index.size()));
+  }
+
+  std::vector<std::byte> out;
+  put_be<uint32_t>(out, CACHE_MAGIC);
+  put_be<uint32_t>(out, CACHE_VERSION);
+  put_be<uint64_t>(out, hash);
+  put_be<uint32_t>(out, static_cast<uint32_t>(sch.imports.size()));
+  put_be<uint32_t>(out, static_cast<uint32_t>(names.size()));
+  put_be<uint32_t>(out, static_cast<uint32_t>(sch.structs.size()));
+  put_be<uint32_t>(out, static_cast<uint32_t>(sch.functions.size()));
+  for (auto& path : sch.imports) {
+    put_string(out, path);
+  }
+  // все имена идут до структур, чтобы при чтении любой номер уже можно было перевести в Symbol
+  for (Symbol sym : names) {
+    put_string(out, Symbols::name(sym));
+  }
+  // структуры - в порядке таблицы имён, так что их имена уже записаны
+  for (std::size_t k = 0; k < sch.structs.size(); k++) {
+    const Struct& st = sch.structs.at(names[k]);
+    put_be<uint32_t>(out, static_cast<uint32_t>(st.fields.size()));
+    for (auto& f : st.fields) {
+      put_string(out, f.name);
+      put_type(out, f.type, index);
+    }
+  }
+  for (auto& [_, fn] : sch.functions) {
+    put_string(out, fn.name);
+    put_type(out, fn.return_type, index);
+    put_be<uint8_t>(out, fn.pure ? 1 : 0);
+    put_be<uint32_t>(out, static_cast<uint32_t>(fn.args.size()));
+    for (auto& a : fn.args) {
+      put_string(out, a.name);
+      put_type(out, a.type, index);
+    }
+  }
+  return out;
+}
+
+Type get_type(Cursor& c, const std::vector<Symbol>& syms) {
+  uint32_t bits = c.get_be<uint32_t>();
+  if (bits & Type::BUILTIN_TAG) {
+    if ((bits & ~Type::BUILTIN_TAG) > static_cast<uint32_t>(Builtin::String)) {
+      throw DeserError("bad builtin");
+    }
+    return Type{bits};
+  }
+  if (bits >= syms.size()) {
+    throw DeserError("bad name index");
+  }
+  return Type::user_of(syms[bits]);
+}
+
+// наименьший размер записи в файле: строка - её длина, поле и аргумент - строка и тип, структура - число полей,
+// функция - имя, тип, флаг pure и число аргументов
+constexpr std::size_t MIN_STRING = sizeof(uint32_t);
+constexpr std::size_t MIN_FIELD = MIN_STRING + sizeof(uint32_t);
+constexpr std::size_t MIN_STRUCT = sizeof(uint32_t);
+constexpr std::size_t MIN_FUNCTION = MIN_STRING + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t);
+
+// число записей, которые ещё могут поместиться в остаток файла. без этой проверки битый счётчик ушёл бы в reserve
+// и запросил гигабайты до того, как чтение упрётся в конец файла
+uint32_t get_count(Cursor& c, std::size_t min_record) {
+  uint32_t n = c.get_be<uint32_t>();
+  if (n > (c.n - c.i) / min_record) {
+    throw DeserError("bad count");
+  }
+  return n;
+}
+
+Schema decode(Cursor& c) {
+  Schema sch;
+  uint32_t n_imports = get_count(c, MIN_STRING);
+  uint32_t n_names = get_count(c, MIN_STRING);
+  uint32_t n_structs = get_count(c, MIN_STRUCT);
+  uint32_t n_functions = get_count(c, MIN_FUNCTION);
+  if (n_structs > n_names) {
+    throw DeserError("bad struct count");
+  }
+  for (uint32_t k = 0; k < n_imports; k++) {
+    sch.imports.emplace_back(c.get_string());
+  }
+  std::vector<Symbol> syms;
+  for (uint32_t k = 0; k < n_names; k++) {
+    syms.push_back(Symbols::intern(c.get_string()));
+  }
+  for (uint32_t k = 0; k < n_structs; k++) {
+    auto [it, inserted] = sch.structs.try_emplace(syms[k]);
+    if (!inserted) {
+      throw DeserError("duplicate struct");
+    }
+    Struct& st = it->second;
+    st.name = Symbols::name(syms[k]);
+    uint32_t n = get_count(c, MIN_FIELD);
+    st.fields.reserve(n);
+    for (uint32_t j = 0; j < n; j++) {
+      std::string_view name = c.get_string();
+      st.fields.push_back({std::string(name), get_type(c, syms)});
+    }
+  }
+  sch.functions.reserve(n_functions);
+  for (uint32_t k = 0; k < n_functions; k++) {
+    Function fn;
+    fn.name = c.get_string();
+    fn.return_type = get_type(c, syms);
+    uint8_t pure = c.get_be<uint8_t>();
+    if (pure > 1) {
+      throw DeserError("bad pure flag");
+    }
+    fn.pure = pure == 1;
+    uint32_t n = get_count(c, MIN_FIELD);
+    fn.args.reserve(n);
+    for (uint32_t j = 0; j < n; j++) {
+      std::string_view name = c.get_string();
+      fn.args.push_back({std::string(name), get_type(c, syms)});
+    }
+    fn.id = function_id(fn.name);
+    std::string key = fn.name;
+    if (!sch.functions.emplace(std::move(key), std::move(fn)).second) {
+      throw DeserError("duplicate function");
+    }
+  }
+  if (c.i != c.n) {
+    throw DeserError("trailing bytes");
+  }
+  return sch;
+}
+} // namespace
+
+uint64_t schema_text_hash(std::string_view text) {
+  return XXH64(text.data(), text.size(), 0);
+}
+
+std::string schema_cache_path(const std::string& schema_path) {
+  return schema_path + ".cache";
+}
+
+std::optional<Schema> load_schema_cache(const std::string& cache_path, uint64_t hash) {
+  try {
+    MappedFile file(cache_path);
+    auto text = file.view();
+    Cursor c{reinterpret_cast<const std::byte*>(text.data()), text.size()};
+    if (c.get_be<uint32_t>() != CACHE_MAGIC || c.get_be<uint32_t>() != CACHE_VERSION ||
+        c.get_be<uint64_t>() != hash) {
+      return std::nullopt;
+    }
+    return decode(c);
+  } catch (const std::exception&) {
+    // битый или чужой файл (в том числе bad_alloc, length_error) - просто промах, схема разберётся из текста
+    return std::nullopt;
+  }
+}
+
+void store_schema_cache(const std::string& cache_path, uint64_t hash, const Schema& sch) {
+  auto bytes = encode(hash, sch);
+  std::string tmp = cache_path + ".tmp." + std::to_string(::getpid());
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return;
+    }
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!out) {
+      out.close();
+      std::remove(tmp.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp.c_str(), cache_path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+  }
+}
+} // namespace ct
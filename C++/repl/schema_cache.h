@@ -0,0 +1,27 @@
+#pragma once
+#include "my_types.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace ct {
+
+// бинарный кеш разобранного файла схемы (результат parse_schema_fragment), лежит рядом с исходным файлом: import,
+// имена и типы, где ссылка на структуру - номер имени в таблице имён файла. при загрузке номера заменяются на Symbol,
+// так что ctpg не нужен. проверки целой схемы (validate_schema) делает загрузчик после сборки всех файлов.
+// кеш привязан к XXH64 текста файла и версии формата
+
+uint64_t schema_text_hash(std::string_view text);
+
+std::string schema_cache_path(const std::string& schema_path);
+
+// nullopt, если кеша нет, он от другого текста, другой версии или битый
+std::optional<Schema> load_schema_cache(const std::string& cache_path, uint64_t hash);
+
+// пишет во временный файл и переименовывает, так что читатель не увидит недописанный кеш.
+// ошибки записи (например, каталог только для чтения) молча игнорируются: кеш - только ускорение
+void store_schema_cache(const std::string& cache_path, uint64_t hash, const Schema& sch);
+
+} // namespace ct
@@ -0,0 +1,79 @@
+#pragma once
+#include "my_types.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace ct {
+
+// текущая версия схемы. без --watch-schema она одна на весь запуск, иначе новую публикует SchemaWatcher.
+// запрос, начатый со старой версией, держит её shared_ptr и спокойно доживает, а старая схема освобождается, когда
+// её отпустит последний такой запрос
+class SchemaHandle {
+public:
+  explicit SchemaHandle(std::shared_ptr<const Schema> sch)
+      : current_(std::move(sch)) {}
+
+  std::shared_ptr<const Schema> load() const {
+    std::lock_guard lock(m_);
+    return current_;
+  }
+
+  // номер версии растёт после каждой публикации, по нему SchemaSnapshot понимает, что пора перечитать указатель
+  uint64_t version() const {
+    return version_.load(std::memory_order_acquire);
+  }
+
+  void publish(std::shared_ptr<const Schema> sch) {
+    {
+      std::lock_guard lock(m_);
+      current_.swap(sch);
+    }
+    // старая версия (теперь в sch) освобождается уже вне мьютекса, если её больше никто не держит
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+private:
+  // указатель под мьютексом: читатели берут его только при смене версии, так что мьютекс почти не занят
+  mutable std::mutex m_;
+  std::shared_ptr<const Schema> current_;
+  std::atomic<uint64_t> version_ = 0;
+};
+
+// схема глазами одного потока. указатель из SchemaHandle перечитываем только когда сменилась версия, в остальное
+// время refresh() - одно атомарное чтение счётчика
+class SchemaSnapshot {
+public:
+  explicit SchemaSnapshot(const SchemaHandle& h)
+      : h_(h)
+      , version_(h.version())
+      , current_(h.load()) {}
+
+  // true, если с прошлого раза вышла новая версия и снимок на неё переключился
+  bool refresh() {
+    uint64_t v = h_.version();
+    if (v == version_) {
+      return false;
+    }
+    version_ = v;
+    current_ = h_.load();
+    return true;
+  }
+
+  const Schema& get() const {
+    return *current_;
+  }
+
+  const std::shared_ptr<const Schema>& share() const {
+    return current_;
+  }
+
+private:
+  const SchemaHandle& h_;
+  uint64_t version_;
+  std::shared_ptr<const Schema> current_;
+};
+
+} // namespace ct
@@ -1,17 +1,182 @@
 #include "schema_loader.h"
 
-#include <fstream>
-#include <iostream>
-#include <sstream>
+#include "autocomplete.h"
+#include "codec_plan.h"
+#include "mapped_file.h"
+#include "schema_cache.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 namespace ct {
-Schema load_schema_file(const std::string& path) {
-  std::ifstream in(path, std::ios::binary);
-  if (!in) {
-    throw SchemaError("Cannot open schema file: " + path);
-  }
-  std::ostringstream s;
-  s << in.rdbuf();
-  return parse_schema_text(s.str());
+namespace {
+
+// один файл: из кеша, если текст не менялся, иначе разбором. текст разбирается прямо из отображения; все имена
+// схема копирует к себе, так что после разбора файл не нужен
+Schema load_fragment(const std::string& path) {
+  MappedFile file(path);
+  uint64_t hash = schema_text_hash(file.view());
+  std::string cache = schema_cache_path(path);
+  if (auto cached = load_schema_cache(cache, hash)) {
+    return std::move(*cached);
+  }
+  Schema sch = parse_schema_fragment(file.view());
+  store_schema_cache(cache, hash, sch);
+  return sch;
+}
+
+// относительный путь в import считается от каталога файла, в котором он записан
+std::string resolve_import(const std::string& from, const std::string& path) {
+  std::filesystem::path p(path);
+  if (p.is_relative()) {
+    p = std::filesystem::path(from).parent_path() / p;
+  }
+  return std::filesystem::weakly_canonical(p).string();
+}
+
+// все файлы, достижимые по import из корня, в порядке обнаружения. файлы читаются и разбираются параллельно: поток
+// берёт следующий путь из очереди, а import из разобранного файла сразу добавляет в очередь. каждый файл грузится
+// один раз, даже если его импортируют несколько раз или по кругу
+class FragmentLoader {
+public:
+  std::vector<Schema> load(const std::string& root) {
+    // корень грузится по пути как есть (он же попадёт в сообщение об ошибке) и на вызывающем потоке: схеме без
+    // import пул не нужен
+    seen_.insert(std::filesystem::weakly_canonical(root).string());
+    paths_.push_back(root);
+    done_.emplace_back();
+    finish(0, root, load_fragment(root));
+    if (!pending_.empty()) {
+      std::size_t n = std::max(1u, std::thread::hardware_concurrency());
+      std::vector<std::jthread> threads;
+      for (std::size_t k = 1; k < n; k++) {
+        threads.emplace_back([this] { work(); });
+      }
+      work();
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    std::vector<Schema> out;
+    for (auto& f : done_) {
+      out.push_back(std::move(*f));
+    }
+    return out;
+  }
+
+  // все найденные пути, включая те, что не успели или не смогли загрузиться. звать после load
+  const std::vector<std::string>& paths() const {
+    return paths_;
+  }
+
+private:
+  // path уже приведён к каноническому виду, по нему и проверяем, что файл ещё не встречался
+  void enqueue(const std::string& path) {
+    if (seen_.insert(path).second) {
+      paths_.push_back(path);
+      done_.emplace_back();
+      pending_.push_back(paths_.size() - 1);
+    }
+  }
+
+  // import разрешаем ещё вне мьютекса, а в очередь добавляем под ним
+  void finish(std::size_t k, const std::string& path, Schema sch) {
+    std::vector<std::string> imports;
+    for (auto& i : sch.imports) {
+      imports.push_back(resolve_import(path, i));
+    }
+    std::lock_guard lock(m_);
+    for (auto& i : imports) {
+      enqueue(i);
+    }
+    done_[k] = std::move(sch);
+  }
+
+  void work() {
+    std::unique_lock lock(m_);
+    for (;;) {
+      cv_.wait(lock, [&] { return error_ || !pending_.empty() || busy_ == 0; });
+      if (error_ || pending_.empty()) {
+        cv_.notify_all();
+        return;
+      }
+      std::size_t k = pending_.front();
+      pending_.pop_front();
+      std::string path = paths_[k];
+      busy_++;
+      lock.unlock();
+      try {
+        finish(k, path, load_fragment(path));
+      } catch (...) {
+        std::lock_guard err_lock(m_);
+        if (!error_) {
+          error_ = std::current_exception();
+        }
+      }
+      lock.lock();
+      busy_--;
+      cv_.notify_all();
+    }
+  }
+
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::unordered_set<std::string> seen_;
+  std::vector<std::string> paths_;
+  std::vector<std::optional<Schema>> done_;
+  std::deque<std::size_t> pending_;
+  std::size_t busy_ = 0;
+  std::exception_ptr error_;
+};
+
+// те же проверки повторов, что и внутри одного файла
+void merge_fragment(Schema& into, Schema& frag) {
+  for (auto& [sym, st] : frag.structs) {
+    if (into.structs.find(sym) != into.structs.end()) {
+      throw SchemaError("Error: Duplicate struct '" + st.name + "'");
+    }
+    into.structs.emplace(sym, std::move(st));
+  }
+  for (auto& [name, fn] : frag.functions) {
+    if (into.functions.find(name) != into.functions.end()) {
+      throw SchemaError("Error: Duplicate function '" + name + "'");
+    }
+    into.functions.emplace(name, std::move(fn));
+  }
+}
+} // namespace
+
+Schema load_schema_file(const std::string& path, std::vector<std::string>* files) {
+  FragmentLoader loader;
+  std::vector<Schema> fragments;
+  try {
+    fragments = loader.load(path);
+  } catch (...) {
+    if (files) {
+      *files = loader.paths();
+    }
+    throw;
+  }
+  if (files) {
+    *files = loader.paths();
+  }
+  Schema sch = std::move(fragments[0]);
+  for (std::size_t k = 1; k < fragments.size(); k++) {
+    merge_fragment(sch, fragments[k]);
+  }
+  sch.imports.clear();
+  validate_schema(sch);
+  // планы и индексы автодополнения - указатели внутрь схемы, их в кеше нет, строятся за линейное время
+  compile_plans(sch);
+  build_completion_index(sch);
+  return sch;
 }
 } // namespace ct
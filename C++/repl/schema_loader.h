@@ -2,7 +2,11 @@
 #include "schema_parser.h"
 
 #include <sstream>
+#include <string>
+#include <vector>
 
 namespace ct {
-Schema load_schema_file(const std::string& path);
+// files, если не nullptr, получает пути всех файлов схемы: корень как передан и разрешённые import. заполняется и
+// тогда, когда загрузка бросила, - теми файлами, что успели найтись
+Schema load_schema_file(const std::string& path, std::vector<std::string>* files = nullptr);
 } // namespace ct
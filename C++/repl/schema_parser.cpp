@@ -4,6 +4,7 @@
 
 #include <iostream>
 #include <unordered_set>
+#include <utility>
 
 namespace ct {
 
@@ -22,10 +23,12 @@ constexpr ctpg::string_term t_str("string");
 
 constexpr char ident_pat[] = "[_A-Za-z][_A-Za-z0-9]*";
 constexpr ctpg::regex_term<ident_pat> t_ident("ident");
+// путь в import: строка в двойных кавычках без экранирования
+constexpr char path_pat[] = R"_("[^"]*")_";
+constexpr ctpg::regex_term<path_pat> t_path("path");
 
 static constexpr auto N_SCHEMA = ctpg::nterm<Schema>("schema");
 static constexpr auto N_ITEMS = ctpg::nterm<Schema>("items");
-static constexpr auto N_ITEM = ctpg::nterm<Schema>("item");
 
 static constexpr auto N_STRUCT = ctpg::nterm<Struct>("struct");
 static constexpr auto N_SFIELDS = ctpg::nterm<std::vector<Field>>("sfields");
@@ -37,67 +40,70 @@ static constexpr auto N_FARG = ctpg::nterm<Arg>("farg");
 
 static constexpr auto N_TYPE = ctpg::nterm<Type>("type");
 
+// один проход по уже собранному списку: имена не копируются, таблица сразу нужного размера
 void ensure_unique(const std::vector<Field>& v, const std::string& ctx) {
-  std::unordered_set<std::string> s;
+  std::unordered_set<std::string_view> s;
+  s.reserve(v.size());
   for (auto& f : v) {
-    if (s.find(f.name) != s.end()) {
+    if (!s.insert(f.name).second) {
       throw SchemaError("Error: Duplicate field '" + f.name + "' in struct '" + ctx + "'");
     }
-    s.insert(f.name);
   }
 }
 
 void ensure_unique(const std::vector<Arg>& v, const std::string& ctx) {
-  std::unordered_set<std::string> s;
+  std::unordered_set<std::string_view> s;
+  s.reserve(v.size());
   for (auto& f : v) {
-    if (s.find(f.name) != s.end()) {
+    if (!s.insert(f.name).second) {
       throw SchemaError("Error: Duplicate argument '" + f.name + "' in function '" + ctx + "'");
     }
-    s.insert(f.name);
   }
 }
 
-Schema merge_items(Schema a, Schema b) {
-  for (auto& s : a.structs) {
-    if (b.structs.find(s.first) != b.structs.end()) {
-      throw SchemaError("Error: Duplicate struct '" + s.first + "'");
-    }
-    b.structs.emplace(s.first, s.second);
-  }
-  for (auto& f : a.functions) {
-    if (b.functions.find(f.first) != b.functions.end()) {
-      throw SchemaError("Error: Duplicate function '" + f.first + "'");
-    }
-    b.functions.emplace(f.first, f.second);
+// items левоассоциативны: каждое новое объявление перемещается в уже накопленную схему, так что сборка линейна по
+// числу объявлений. повтор ловится тут же одним поиском в накопленной таблице
+Schema add_struct(Schema items, Struct s) {
+  Symbol sym = Symbols::intern(s.name);
+  if (items.structs.find(sym) != items.structs.end()) {
+    throw SchemaError("Error: Duplicate struct '" + s.name + "'");
   }
-  return b;
+  items.structs.emplace(sym, std::move(s));
+  return items;
 }
 
-Schema empty_items() {
-  return Schema{};
+Schema add_fn(Schema items, Function f) {
+  if (items.functions.find(f.name) != items.functions.end()) {
+    throw SchemaError("Error: Duplicate function '" + f.name + "'");
+  }
+  std::string name = f.name;
+  items.functions.emplace(std::move(name), std::move(f));
+  return items;
 }
 
-Schema item_from_struct(Struct s) {
-  Schema sch;
-  sch.structs.emplace(s.name, s);
-  return sch;
+// import, как и pure, - обычный идентификатор, а не ключевое слово, так что поля, аргументы и типы с именем import
+// по-прежнему разбираются
+Schema add_import(Schema items, std::string_view kw, std::string_view path, char) {
+  if (kw != "import") {
+    throw SchemaError("Error: Unknown directive '" + std::string(kw) + "'");
+  }
+  items.imports.emplace_back(path.substr(1, path.size() - 2));
+  return items;
 }
 
-Schema item_from_fn(Function f) {
-  Schema sch;
-  sch.functions.emplace(f.name, f);
-  return sch;
+Schema empty_items() {
+  return Schema{};
 }
 
 Struct make_struct(std::string_view, std::string_view id, char, std::vector<Field> fs, char) {
-  Struct s{std::string(id), fs};
+  Struct s{std::string(id), std::move(fs)};
   ensure_unique(s.fields, s.name);
   return s;
 }
 
+// уникальность полей проверяется один раз в make_struct, когда список уже собран
 std::vector<Field> append_field(std::vector<Field> rest, Field f) {
-  rest.push_back(f);
-  ensure_unique(rest, f.name);
+  rest.push_back(std::move(f));
   return rest;
 }
 
@@ -111,14 +117,34 @@ Field make_field(Type t, std::string_view id, char) {
 
 Function
 make_function(std::string_view, std::string_view id, std::string_view, Type ret, char, std::vector<Arg> args, char) {
-  Function f{std::string(id), ret, args};
+  Function f{std::string(id), ret, std::move(args)};
+  f.id = function_id(f.name);
   ensure_unique(f.args, f.name);
   return f;
 }
 
+// маркер после типа ответа - обычный идентификатор, а не ключевое слово, так что поля, аргументы и типы с именем pure
+// по-прежнему разбираются
+Function make_marked_function(
+    std::string_view fn,
+    std::string_view id,
+    std::string_view arrow,
+    Type ret,
+    std::string_view marker,
+    char lb,
+    std::vector<Arg> args,
+    char rb
+) {
+  if (marker != "pure") {
+    throw SchemaError("Error: Unknown marker '" + std::string(marker) + "' in function '" + std::string(id) + "'");
+  }
+  Function f = make_function(fn, id, arrow, ret, lb, std::move(args), rb);
+  f.pure = true;
+  return f;
+}
+
 std::vector<Arg> append_arg(std::vector<Arg> rest, Arg a) {
-  rest.push_back(a);
-  ensure_unique(rest, a.name);
+  rest.push_back(std::move(a));
   return rest;
 }
 
@@ -152,20 +178,19 @@ Type type_string(std::string_view) {
 }
 
 Type type_user(std::string_view id) {
-  return Type{std::nullopt, std::string(id)};
+  return Type::user_of(id);
 }
 
 static constexpr auto SCHEMA_PARSER = ctpg::parser(
     N_SCHEMA,
-    terms(t_fn, t_struct, t_arrow, t_lbrace, t_rbrace, t_sc, t_i32, t_i64, t_u64, t_u32, t_str, t_ident),
-    nterms(N_SCHEMA, N_ITEMS, N_ITEM, N_STRUCT, N_SFIELDS, N_SFIELD, N_FN, N_FARGS, N_FARG, N_TYPE),
+    terms(t_fn, t_struct, t_arrow, t_lbrace, t_rbrace, t_sc, t_i32, t_i64, t_u64, t_u32, t_str, t_ident, t_path),
+    nterms(N_SCHEMA, N_ITEMS, N_STRUCT, N_SFIELDS, N_SFIELD, N_FN, N_FARGS, N_FARG, N_TYPE),
     rules(
         N_SCHEMA(N_ITEMS) >= [](Schema s) { return s; },
 
-        N_ITEM(N_STRUCT) >= item_from_struct,
-        N_ITEM(N_FN) >= item_from_fn,
-
-        N_ITEMS(N_ITEM, N_ITEMS) >= merge_items,
+        N_ITEMS(N_ITEMS, N_STRUCT) >= add_struct,
+        N_ITEMS(N_ITEMS, N_FN) >= add_fn,
+        N_ITEMS(N_ITEMS, t_ident, t_path, t_sc) >= add_import,
         N_ITEMS() >= empty_items,
 
         N_STRUCT(t_struct, t_ident, t_lbrace, N_SFIELDS, t_rbrace) >= make_struct,
@@ -176,6 +201,7 @@ static constexpr auto SCHEMA_PARSER = ctpg::parser(
         N_SFIELDS() >= empty_fields,
 
         N_FN(t_fn, t_ident, t_arrow, N_TYPE, t_lbrace, N_FARGS, t_rbrace) >= make_function,
+        N_FN(t_fn, t_ident, t_arrow, N_TYPE, t_ident, t_lbrace, N_FARGS, t_rbrace) >= make_marked_function,
 
         N_FARGS(N_FARGS, N_FARG) >= append_arg,
         N_FARGS() >= empty_args,
@@ -191,34 +217,66 @@ static constexpr auto SCHEMA_PARSER = ctpg::parser(
     )
 );
 
+// буфер ctpg поверх чужого текста, с тем же интерфейсом, что у ctpg::buffers::string_buffer, но без своей копии
+// строки. текст должен жить, пока идёт разбор
+class string_view_buffer {
+public:
+  using iterator = std::string_view::const_iterator;
+
+  explicit string_view_buffer(std::string_view text)
+      : text_(text) {}
+
+  iterator begin() const {
+    return text_.cbegin();
+  }
+
+  iterator end() const {
+    return text_.cend();
+  }
+
+  std::string_view get_view(const iterator& start, const iterator& end) const {
+    return std::string_view(text_.data() + (start - text_.cbegin()), end - start);
+  }
+
+private:
+  std::string_view text_;
+};
+
 void check_user_type(const Schema& out, const Type& t, const std::string& ctx) {
-  if (!t.is_builtin() && !out.find_struct(*t.user)) {
-    throw SchemaError("Error: Unknown type '" + *t.user + "' in " + ctx);
+  if (!t.is_builtin() && !out.find_struct(t)) {
+    throw SchemaError("Error: Unknown type '" + t.str() + "' in " + ctx);
   }
 }
 
-Schema parse_schema_text(std::string_view text) {
-  Schema out;
-  using namespace ctpg::buffers;
-  if (auto res = SCHEMA_PARSER.parse(string_buffer(std::string(text)))) {
-    out = *res;
-    for (auto& [_, s] : out.structs) {
-      for (auto& f : s.fields) {
-        check_user_type(out, f.type, "struct '" + s.name + "'");
-        if (!f.type.is_builtin() && s.name == *f.type.user) {
-          throw SchemaError("Recursive struct");
-        }
+Schema parse_schema_fragment(std::string_view text) {
+  if (auto res = SCHEMA_PARSER.parse(string_view_buffer(text))) {
+    return std::move(*res);
+  }
+  throw SchemaError("Error: failed to parse schema");
+}
+
+void validate_schema(Schema& out) {
+  for (auto& [sym, s] : out.structs) {
+    for (auto& f : s.fields) {
+      check_user_type(out, f.type, "struct '" + s.name + "'");
+      if (f.type == Type::user_of(sym)) {
+        throw SchemaError("Recursive struct");
       }
     }
+  }
 
-    for (auto& [_, f] : out.functions) {
-      check_user_type(out, f.return_type, "function return '" + f.name + "'");
-      for (auto& a : f.args) {
-        check_user_type(out, a.type, "function arg '" + f.name + "." + a.name + "'");
-      }
+  for (auto& [_, f] : out.functions) {
+    check_user_type(out, f.return_type, "function return '" + f.name + "'");
+    for (auto& a : f.args) {
+      check_user_type(out, a.type, "function arg '" + f.name + "." + a.name + "'");
     }
-    return out;
   }
-  throw SchemaError("Error: failed to parse schema");
+  out.by_id.build(out.functions);
+}
+
+Schema parse_schema_text(std::string_view text) {
+  Schema out = parse_schema_fragment(text);
+  validate_schema(out);
+  return out;
 }
 } // namespace ct
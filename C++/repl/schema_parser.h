@@ -3,6 +3,15 @@
 
 namespace ct {
 
+// разбор одного файла. здесь ловятся только повторы внутри него: типы из других файлов (import) ещё не видны,
+// поэтому неизвестные типы и прочее проверяет validate_schema уже на собранной схеме. пути из import складываются в
+// Schema::imports как записаны
+Schema parse_schema_fragment(std::string_view text);
+
+// проверки целой схемы (неизвестные типы, рекурсия) и построение Schema::by_id
+void validate_schema(Schema& sch);
+
+// схема из одного текста: parse_schema_fragment + validate_schema
 Schema parse_schema_text(std::string_view text);
 
 } // namespace ct
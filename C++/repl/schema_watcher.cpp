@@ -0,0 +1,135 @@
+#include "schema_watcher.h"
+
+#include "schema_loader.h"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace ct {
+
+SchemaWatcher::SchemaWatcher(std::string path, const std::vector<std::string>& files, SchemaHandle& handle)
+    : path_(std::move(path))
+    , handle_(handle) {
+  inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0) {
+    throw SchemaError(std::string("Cannot watch schema: ") + std::strerror(errno));
+  }
+  try {
+    watch_files(files);
+  } catch (...) {
+    ::close(inotify_fd_);
+    throw;
+  }
+  stop_fd_ = ::eventfd(0, EFD_CLOEXEC);
+  if (stop_fd_ < 0) {
+    int err = errno;
+    ::close(inotify_fd_);
+    throw SchemaError(std::string("Cannot watch schema: ") + std::strerror(err));
+  }
+  thread_ = std::thread([this] { loop(); });
+}
+
+SchemaWatcher::~SchemaWatcher() {
+  uint64_t one = 1;
+  [[maybe_unused]] auto n = ::write(stop_fd_, &one, sizeof(one));
+  thread_.join();
+  ::close(stop_fd_);
+  ::close(inotify_fd_);
+}
+
+void SchemaWatcher::loop() {
+  for (;;) {
+    pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+    if (::poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "Error: schema watcher stopped: " << std::strerror(errno) << '\n';
+      return;
+    }
+    if (fds[1].revents) {
+      return;
+    }
+    // одна запись файла даёт пачку событий - перечитываем один раз на пачку
+    if (drain_events()) {
+      reload();
+    }
+  }
+}
+
+bool SchemaWatcher::drain_events() {
+  bool ours = false;
+  alignas(inotify_event) char buf[4096];
+  for (;;) {
+    ssize_t len = ::read(inotify_fd_, buf, sizeof(buf));
+    if (len <= 0) {
+      return ours;
+    }
+    for (ssize_t pos = 0; pos < len;) {
+      auto* ev = reinterpret_cast<const inotify_event*>(buf + pos);
+      auto dir = dirs_.find(ev->wd);
+      if (ev->len > 0 && dir != dirs_.end() &&
+          files_.contains((std::filesystem::path(dir->second) / ev->name).string())) {
+        ours = true;
+      }
+      pos += static_cast<ssize_t>(sizeof(inotify_event) + ev->len);
+    }
+  }
+}
+
+void SchemaWatcher::reload() {
+  std::vector<std::string> files;
+  try {
+    handle_.publish(std::make_shared<const Schema>(load_schema_file(path_, &files)));
+    std::cerr << "Schema reloaded: " << path_ << '\n';
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Error: schema reload failed, keeping the previous version: " << e.what() << '\n';
+    // в ходу по-прежнему старая версия: следим и за её файлами, и за новыми, чтобы поймать исправление
+    files.insert(files.end(), files_.begin(), files_.end());
+  }
+  try {
+    watch_files(files);
+  } catch (const SchemaError& e) {
+    std::cerr << "Error: " << e.what() << '\n';
+  }
+}
+
+void SchemaWatcher::watch_files(const std::vector<std::string>& files) {
+  std::unordered_set<std::string> paths;
+  std::unordered_set<std::string> dirs;
+  for (auto& f : files) {
+    std::filesystem::path p = std::filesystem::absolute(f).lexically_normal();
+    dirs.insert(p.parent_path().string());
+    paths.insert(p.string());
+  }
+  std::unordered_map<int, std::string> watched;
+  std::string error;
+  for (auto& dir : dirs) {
+    // на уже отслеживаемый каталог inotify отдаёт ту же подписку
+    int wd = ::inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+      if (error.empty()) {
+        error = "Cannot watch schema directory " + dir + ": " + std::strerror(errno);
+      }
+      continue;
+    }
+    watched.emplace(wd, dir);
+  }
+  for (auto& [wd, dir] : dirs_) {
+    if (!watched.contains(wd)) {
+      ::inotify_rm_watch(inotify_fd_, wd);
+    }
+  }
+  dirs_ = std::move(watched);
+  files_ = std::move(paths);
+  if (!error.empty()) {
+    throw SchemaError(error);
+  }
+}
+} // namespace ct
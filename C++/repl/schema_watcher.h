@@ -0,0 +1,47 @@
+#pragma once
+#include "schema_handle.h"
+
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ct {
+
+// следит за файлами схемы через inotify (за их каталогами, чтобы ловить и замену файла через rename) и на каждое
+// изменение корня или любого импортированного файла перечитывает схему в своём потоке, публикуя её в handle. после
+// перечитывания набор файлов обновляется: новые import начинают отслеживаться. новая схема с ошибкой не публикуется:
+// ошибка пишется в stderr, а запросы продолжают идти со старой версией
+class SchemaWatcher {
+public:
+  // files - файлы уже загруженной схемы, как их отдаёт load_schema_file. бросает SchemaError, если не получилось
+  // подписаться на изменения
+  SchemaWatcher(std::string path, const std::vector<std::string>& files, SchemaHandle& handle);
+  ~SchemaWatcher();
+
+  SchemaWatcher(const SchemaWatcher&) = delete;
+  SchemaWatcher& operator=(const SchemaWatcher&) = delete;
+
+private:
+  void loop();
+  // true, если среди накопившихся событий есть событие про один из наших файлов
+  bool drain_events();
+  void reload();
+  // подписывается на каталоги files и снимает подписки с ненужных. каталог, на который подписаться не вышло,
+  // пропускается, а ошибка бросается как SchemaError в конце
+  void watch_files(const std::vector<std::string>& files);
+
+  std::string path_;
+  SchemaHandle& handle_;
+  // абсолютные пути отслеживаемых файлов
+  std::unordered_set<std::string> files_;
+  // каталог каждой подписки inotify, чтобы собрать полный путь из события
+  std::unordered_map<int, std::string> dirs_;
+  int inotify_fd_ = -1;
+  // eventfd, через который деструктор будит и останавливает поток
+  int stop_fd_ = -1;
+  std::thread thread_;
+};
+
+} // namespace ct
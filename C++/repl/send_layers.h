@@ -0,0 +1,24 @@
+#pragma once
+#include "my_types.h"
+#include "response_cache.h"
+#include "rpc/client.h"
+#include "single_flight.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace ct {
+
+// что стоит перед rpc::Client::send. оба слоя необязательны и живут у вызывающего, без них send - просто
+// client.send
+struct SendLayers {
+  // ответы pure-функций: попадание вообще не ходит в сеть, промах кладётся сюда
+  ResponseCache* cache = nullptr;
+  // одинаковые запросы в полёте делят одну отправку
+  SingleFlight* flight = nullptr;
+
+  // ответ на уже сериализованный запрос к fn
+  std::vector<std::byte> send(const Function& fn, rpc::Client& client, const std::vector<std::byte>& req) const;
+};
+
+} // namespace ct
@@ -4,18 +4,18 @@
 #include "my_types.h"
 #include "request_classes.h"
 
-#include <xxhash.h>
+#include <cstring>
+#include <vector>
 
 namespace ct {
-// сериализация примитивных типов
-void Serializer::serialize_builtin(Builtin b, const Value& v) {
+// проверка и приведение примитивных типов
+WireItem to_wire_item(Builtin b, const Value& v) {
   if (b == Builtin::String) {
-    if (!v.is<std::string>()) {
+    if (!v.is<std::pmr::string>()) {
       throw SerializeError("excepted string");
     }
-    const std::string& s = v.as<std::string>();
-    put_be<uint32_t>(out, static_cast<uint32_t>(s.size()));
-    put_bytes(out, std::as_bytes(std::span(s)));
+    const auto& s = v.as<std::pmr::string>();
+    return {b, 0, s};
   } else if (b == Builtin::Int32) {
     int64_t x;
     if (v.is_int()) {
@@ -29,7 +29,7 @@ void Serializer::serialize_builtin(Builtin b, const Value& v) {
     if (x < INT32_MIN) {
       throw SerializeError("int32 underflow");
     }
-    put_be<int32_t>(out, static_cast<int32_t>(x));
+    return {b, static_cast<uint32_t>(static_cast<int32_t>(x))};
   } else if (b == Builtin::Int64) {
     int64_t x;
     if (v.is_int()) {
@@ -37,7 +37,7 @@ void Serializer::serialize_builtin(Builtin b, const Value& v) {
     } else {
       throw SerializeError("excepted int64");
     }
-    put_be<int64_t>(out, x);
+    return {b, static_cast<uint64_t>(x)};
   } else if (b == Builtin::Uint32) {
     uint64_t x;
     if (v.is_int()) {
@@ -53,7 +53,7 @@ void Serializer::serialize_builtin(Builtin b, const Value& v) {
     if (x > 0xffffffffULL) {
       throw SerializeError("uint32 out of range");
     }
-    put_be<uint32_t>(out, static_cast<uint32_t>(x));
+    return {b, x};
   } else if (b == Builtin::Uint64) {
     uint64_t x;
     if (v.is_int()) {
@@ -66,58 +66,111 @@ void Serializer::serialize_builtin(Builtin b, const Value& v) {
     } else {
       throw SerializeError("excepted uint64");
     }
-    put_be<uint64_t>(out, x);
+    return {b, x};
   }
+  return {b};
 }
 
-// сериализация всех полей
-void Serializer::serialize_struct(const Struct& st, const StructValue& sv) {
-  for (auto& fld : st.fields) {
-    auto it = sv.fields.find(fld.name);
-    if (it == sv.fields.end()) {
-      throw SerializeError("missing struct field '" + fld.name + "' for '" + st.name + "'");
-    }
-    serialize_value(fld.type, it->second);
+std::size_t wire_size(const WireItem& it) {
+  if (it.builtin == Builtin::String) {
+    return sizeof(uint32_t) + it.str.size();
+  }
+  if (it.builtin == Builtin::Int32 || it.builtin == Builtin::Uint32) {
+    return sizeof(uint32_t);
+  }
+  return sizeof(uint64_t);
+}
+
+std::byte* write_wire_item(std::byte* dst, const WireItem& it) {
+  if (it.builtin == Builtin::String) {
+    store_be<uint32_t>(dst, static_cast<uint32_t>(it.str.size()));
+    std::memcpy(dst + sizeof(uint32_t), it.str.data(), it.str.size());
+    return dst + sizeof(uint32_t) + it.str.size();
+  }
+  if (it.builtin == Builtin::Int32 || it.builtin == Builtin::Uint32) {
+    store_be<uint32_t>(dst, static_cast<uint32_t>(it.bits));
+    return dst + sizeof(uint32_t);
   }
+  store_be<uint64_t>(dst, it.bits);
+  return dst + sizeof(uint64_t);
 }
 
-// is_builtin - проверка, встроенный ли тип
-void Serializer::serialize_value(const Type& t, const Value& v) {
-  if (t.is_builtin()) {
-    serialize_builtin(*t.builtin, v);
-  } else {
-    const auto* st = sch.find_struct(*t.user);
-    if (!st) {
-      throw SerializeError("unknown struct type");
+void Serializer::serialize_builtin(Builtin b, const Value& v) {
+  WireItem it = to_wire_item(b, v);
+  size += wire_size(it);
+  items.push_back(it);
+}
+
+// аргументы ищутся по имени среди переданных, а поля вложенных структур - по op.field в значении структуры
+void Serializer::serialize_args(const Function& fn, const ProvidedArgs& provided) {
+  for (auto& op : fn.plan.args) {
+    auto it = provided.find(*op.name);
+    if (it == provided.end()) {
+      throw SerializeError("missing arg");
     }
-    const auto& sv = v.as<StructValue>();
-    if (!sv.struct_name.empty() && sv.struct_name != st->name) {
-      throw SerializeError("struct literal name mismatch");
+    serialize_value(op, *it->second);
+  }
+}
+
+void Serializer::serialize_value(const PlanOp& op, const Value& v) {
+  if (op.kind == PlanOpKind::Builtin) {
+    serialize_builtin(op.builtin, v);
+    return;
+  }
+  if (!v.is<StructValue>()) {
+    throw SerializeError("excepted struct '" + op.st->name + "'");
+  }
+  const auto& sv = v.as<StructValue>();
+  if (sv.st != op.st) {
+    throw SerializeError("struct literal name mismatch");
+  }
+  for (auto& field : op.st->plan) {
+    const Value& fv = sv.fields[field.field];
+    if (fv.is<std::monostate>()) {
+      throw SerializeError("missing struct field '" + *field.name + "' for '" + sv.st->name + "'");
     }
-    serialize_struct(*st, sv);
+    serialize_value(field, fv);
+  }
+}
+
+void Serializer::write_items() {
+  std::size_t pos = out.size();
+  out.resize(pos + size);
+  std::byte* dst = out.data() + pos;
+  for (auto& it : items) {
+    dst = write_wire_item(dst, it);
   }
 }
 
 // сначала сериализуем название функции, потом её аргументы
-std::vector<std::byte> serialize_call(const Schema& sch, const Call& call) {
+void serialize_call_into(
+    const Schema& sch,
+    const Call& call,
+    std::vector<std::byte>& out,
+    std::pmr::memory_resource* mr
+) {
   const auto* fn = sch.find_function(call.func_name);
   if (!fn) {
-    throw SerializeError("unknown function '" + call.func_name + "'");
+    throw SerializeError("unknown function '" + std::string(call.func_name) + "'");
   }
-  std::unordered_map<std::string, Value> provided;
+  // повторный аргумент не перетирает первый, как и раньше
+  ProvidedArgs provided(mr);
   for (auto& a : call.args) {
-    provided.emplace(a.name, a.value);
+    provided.emplace(a.name, &a.value);
   }
-  Serializer ser(sch);
-  uint32_t h = XXH32(call.func_name.data(), call.func_name.size(), 0);
-  put_be<uint32_t>(ser.out, h);
-  for (auto& def : fn->args) {
-    auto it = provided.find(def.name);
-    if (it == provided.end()) {
-      throw SerializeError("missing arg");
-    }
-    ser.serialize_value(def.type, it->second);
-  }
-  return ser.out;
+  thread_local std::vector<WireItem> items;
+  items.clear();
+  out.clear();
+  Serializer ser(sch, out, items);
+  ser.serialize_args(*fn, provided);
+  out.reserve(sizeof(uint32_t) + ser.size);
+  put_be<uint32_t>(out, fn->id);
+  ser.write_items();
+}
+
+std::vector<std::byte> serialize_call(const Schema& sch, const Call& call, std::pmr::memory_resource* mr) {
+  std::vector<std::byte> out;
+  serialize_call_into(sch, call, out, mr);
+  return out;
 }
 } // namespace ct
@@ -3,28 +3,70 @@
 #include "my_types.h"
 #include "request_classes.h"
 
+#include <cstdint>
+#include <memory_resource>
 #include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace ct {
 struct SerializeError : std::runtime_error {
   using std::runtime_error::runtime_error;
 };
 
+// аргументы запроса по имени; значения не копируются, а берутся из Call
+using ProvidedArgs = std::pmr::unordered_map<std::string_view, const Value*>;
+
+// примитив запроса, уже проверенный и приведённый к своей ширине на проводе
+struct WireItem {
+  Builtin builtin;
+  uint64_t bits = 0;
+  std::string_view str{};
+};
+
+// бросает SerializeError, если значение не подходит под тип. строка в результате ссылается на v
+WireItem to_wire_item(Builtin b, const Value& v);
+
+std::size_t wire_size(const WireItem& it);
+
+// пишет item по адресу dst (места должно хватать) и возвращает адрес сразу за ним
+std::byte* write_wire_item(std::byte* dst, const WireItem& it);
+
+// сериализация в два прохода: сначала по плану собираем и проверяем все примитивы (items) и считаем точный размер
+// запроса, потом один раз расширяем out и пишем всё подряд без перевыделений
 struct Serializer {
   const Schema& sch;
-  std::vector<std::byte> out;
+  std::vector<std::byte>& out;
+  std::vector<WireItem>& items;
+  std::size_t size = 0;
 
-  Serializer(const Schema& s)
-      : sch(s) {}
+  Serializer(const Schema& s, std::vector<std::byte>& o, std::vector<WireItem>& it)
+      : sch(s)
+      , out(o)
+      , items(it) {}
 
   void serialize_builtin(Builtin b, const Value& v);
 
-  void serialize_struct(const Struct& st, const StructValue& sv);
+  // прогоняем план аргументов функции (Function::plan.args) по значениям из запроса
+  void serialize_args(const Function& fn, const ProvidedArgs& provided);
 
-  void serialize_value(const Type& t, const Value& v);
+  // значение одной операции плана; поля структуры - по её Struct::plan
+  void serialize_value(const PlanOp& op, const Value& v);
 
-  std::vector<std::byte> serialize_call(const Call& call);
+  void write_items();
 };
 
-std::vector<std::byte> serialize_call(const Schema& sch, const Call& call);
+// пишет запрос в out, затирая прошлое содержимое, но сохраняя выделенную память.
+// удобно держать по буферу на поток и не аллоцировать новый вектор на каждый запрос
+// временные структуры сериализатора берутся из mr
+void serialize_call_into(
+    const Schema& sch,
+    const Call& call,
+    std::vector<std::byte>& out,
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource()
+);
+
+std::vector<std::byte>
+serialize_call(const Schema& sch, const Call& call, std::pmr::memory_resource* mr = std::pmr::get_default_resource());
 } // namespace ct
@@ -0,0 +1,82 @@
+#include "single_flight.h"
+
+#include <memory>
+#include <string_view>
+
+namespace ct {
+
+std::vector<std::byte> SingleFlight::send(rpc::Client& client, const std::vector<std::byte>& req) {
+  std::string_view key(reinterpret_cast<const char*>(req.data()), req.size());
+  std::promise<std::vector<std::byte>> leader;
+  {
+    std::unique_lock lock(m_);
+    if (auto it = inflight_.find(key); it != inflight_.end()) {
+      std::shared_future<std::vector<std::byte>> shared = it->second;
+      stats_.joined++;
+      lock.unlock();
+      return shared.get();
+    }
+    inflight_.emplace(std::string(key), leader.get_future().share());
+    stats_.sent++;
+  }
+
+  // запись убираем до того, как отдать ответ: кто придёт после, отправит свой запрос, а не возьмёт уже готовый
+  auto forget = [&] {
+    std::lock_guard lock(m_);
+    inflight_.erase(inflight_.find(key));
+  };
+  std::vector<std::byte> resp;
+  try {
+    resp = client.send(req);
+  } catch (...) {
+    forget();
+    leader.set_exception(std::current_exception());
+    throw;
+  }
+  forget();
+  leader.set_value(resp);
+  return resp;
+}
+
+std::shared_future<std::vector<std::byte>> SingleFlight::send(AsyncClient& client, std::span<const std::byte> req) {
+  std::string key(reinterpret_cast<const char*>(req.data()), req.size());
+  auto leader = std::make_shared<std::promise<std::vector<std::byte>>>();
+  std::shared_future<std::vector<std::byte>> shared;
+  {
+    std::lock_guard lock(m_);
+    if (auto it = inflight_.find(key); it != inflight_.end()) {
+      stats_.joined++;
+      return it->second;
+    }
+    shared = leader->get_future().share();
+    inflight_.emplace(key, shared);
+    stats_.sent++;
+  }
+
+  // колбэк зовётся из потока клиента; запись убираем до того, как отдать ответ, как и в синхронном send
+  auto forget = [this, key] {
+    std::lock_guard lock(m_);
+    inflight_.erase(key);
+  };
+  try {
+    client.send(req, [forget, leader](std::vector<std::byte> resp, std::exception_ptr err) {
+      forget();
+      if (err) {
+        leader->set_exception(err);
+      } else {
+        leader->set_value(std::move(resp));
+      }
+    });
+  } catch (...) {
+    forget();
+    leader->set_exception(std::current_exception());
+    throw;
+  }
+  return shared;
+}
+
+SingleFlightStats SingleFlight::stats() const {
+  std::lock_guard lock(m_);
+  return stats_;
+}
+} // namespace ct
@@ -0,0 +1,44 @@
+#pragma once
+#include "async_client.h"
+#include "my_types.h"
+#include "rpc/client.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ct {
+
+struct SingleFlightStats {
+  // запросы, которые сами ушли в сеть
+  uint64_t sent = 0;
+  // запросы, которые дождались чужого такого же запроса
+  uint64_t joined = 0;
+};
+
+// склейка одинаковых запросов в полёте: пока запрос с теми же байтами ждёт ответа, новые такие же не уходят в сеть,
+// а получают его ответ (или его исключение). как только ответ пришёл, запись убирается, так что это не кеш - следующий
+// такой же запрос снова пойдёт на сервер. можно звать из любых потоков
+class SingleFlight {
+public:
+  std::vector<std::byte> send(rpc::Client& client, const std::vector<std::byte>& req);
+
+  // то же для AsyncClient, не блокируясь: будущий ответ общий у всех одинаковых запросов, отправленных, пока он не
+  // пришёл. таблица та же, так что синхронный вызов тоже может дождаться асинхронного
+  std::shared_future<std::vector<std::byte>> send(AsyncClient& client, std::span<const std::byte> req);
+
+  SingleFlightStats stats() const;
+
+private:
+  mutable std::mutex m_;
+  std::unordered_map<std::string, std::shared_future<std::vector<std::byte>>, StringHash, std::equal_to<>> inflight_;
+  SingleFlightStats stats_;
+};
+
+} // namespace ct
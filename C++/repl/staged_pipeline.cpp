@@ -0,0 +1,207 @@
+#include "staged_pipeline.h"
+
+#include "bounded_queue.h"
+#include "deserializer.h"
+#include "direct_encoder.h"
+#include "output_buffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ct {
+namespace {
+
+struct LineJob {
+  std::size_t seq;
+  std::string line;
+};
+
+struct SendJob {
+  std::size_t seq;
+  std::shared_ptr<const Schema> sch;
+  const Function* fn;
+  std::vector<std::byte> req;
+};
+
+struct DecodeJob {
+  std::size_t seq;
+  std::shared_ptr<const Schema> sch;
+  const Function* fn;
+  std::vector<std::byte> resp;
+};
+
+// печатает результаты строго по seq. каждый слот кольца занят ровно одной строкой, которая сейчас в полёте:
+// читатель берёт разрешение у free_ перед тем, как выдать новый seq, а писатель возвращает его после печати,
+// поэтому seq - next_ всегда меньше размера кольца
+class OrderedWriter {
+public:
+  explicit OrderedWriter(std::size_t window)
+      : slots_(window)
+      , free_(static_cast<std::ptrdiff_t>(window)) {}
+
+  void acquire_slot() {
+    free_.acquire();
+  }
+
+  void put(std::size_t seq, std::string out) {
+    std::lock_guard lock(m_);
+    slots_[seq % slots_.size()] = std::move(out);
+    cv_.notify_one();
+  }
+
+  void finish(std::size_t total) {
+    std::lock_guard lock(m_);
+    finished_ = true;
+    total_ = total;
+    cv_.notify_one();
+  }
+
+  // печатаем в out; в stdout он уходит большими кусками, а остаток сбрасывает вызывающий. прежде чем ждать
+  // следующую строку, напечатанное сбрасывается: программа, которая пишет в repl по строке и ждёт ответа, иначе его
+  // не дождётся
+  void drain(OutputBuffer& out) {
+    for (;;) {
+      std::unique_lock lock(m_);
+      auto& slot = slots_[next_ % slots_.size()];
+      if (!slot && !(finished_ && next_ == total_) && out.size() > 0) {
+        lock.unlock();
+        out.flush(std::cout);
+        continue;
+      }
+      cv_.wait(lock, [&] { return slot.has_value() || (finished_ && next_ == total_); });
+      if (!slot) {
+        return;
+      }
+      std::string line = std::move(*slot);
+      slot.reset();
+      ++next_;
+      lock.unlock();
+      out.append(line);
+      out.push_back('\n');
+      out.flush_if_full(std::cout);
+      free_.release();
+    }
+  }
+
+private:
+  std::vector<std::optional<std::string>> slots_;
+  std::counting_semaphore<> free_;
+  std::size_t next_ = 0;
+  std::size_t total_ = 0;
+  bool finished_ = false;
+  std::mutex m_;
+  std::condition_variable cv_;
+};
+
+// запускает n потоков стадии; когда завершается последний из них, закрываем очередь следующей стадии
+template <typename Body, typename Next>
+void spawn_stage(std::vector<std::jthread>& threads, std::size_t n, Body body, BoundedQueue<Next>& next) {
+  auto alive = std::make_shared<std::atomic<std::size_t>>(n);
+  for (std::size_t k = 0; k < n; k++) {
+    threads.emplace_back([body, alive, &next] {
+      body();
+      if (alive->fetch_sub(1) == 1) {
+        next.close();
+      }
+    });
+  }
+}
+
+std::string error_line(const std::runtime_error& e) {
+  return std::string("Error: ") + e.what();
+}
+} // namespace
+
+void run_no_tty_staged(const SchemaHandle& sch, const Options& opts, SendLayers layers) {
+  std::size_t workers = opts.workers == 0 ? 1 : opts.workers;
+  std::size_t senders = opts.inflight == 0 ? 1 : opts.inflight;
+  std::size_t window = 2 * (senders + 2 * workers);
+
+  std::vector<std::unique_ptr<rpc::Client>> clients;
+  for (std::size_t k = 0; k < senders; k++) {
+    clients.push_back(std::make_unique<rpc::Client>(opts.rpc_host, opts.rpc_port, opts.rpc_path));
+  }
+
+  OrderedWriter writer(window);
+  BoundedQueue<LineJob> lines(window);
+  BoundedQueue<SendJob> sends(window);
+  BoundedQueue<DecodeJob> decodes(window);
+  std::vector<std::jthread> threads;
+
+  threads.emplace_back([&] {
+    std::size_t seq = 0;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      writer.acquire_slot();
+      lines.push({seq++, std::move(line)});
+    }
+    lines.close();
+    writer.finish(seq);
+  });
+
+  spawn_stage(
+      threads,
+      workers,
+      [&] {
+        SchemaSnapshot snap(sch);
+        while (auto job = lines.pop()) {
+          snap.refresh();
+          try {
+            std::vector<std::byte> req;
+            const Function& fn = encode_request(snap.get(), job->line, req);
+            sends.push({job->seq, snap.share(), &fn, std::move(req)});
+          } catch (const std::runtime_error& e) {
+            writer.put(job->seq, error_line(e));
+          }
+        }
+      },
+      sends
+  );
+
+  std::atomic<std::size_t> next_client = 0;
+  spawn_stage(
+      threads,
+      senders,
+      [&] {
+        auto& client = *clients[next_client++];
+        while (auto job = sends.pop()) {
+          try {
+            auto resp = layers.send(*job->fn, client, job->req);
+            decodes.push({job->seq, std::move(job->sch), job->fn, std::move(resp)});
+          } catch (const std::runtime_error& e) {
+            writer.put(job->seq, error_line(e));
+          }
+        }
+      },
+      decodes
+  );
+
+  for (std::size_t k = 0; k < workers; k++) {
+    threads.emplace_back([&] {
+      while (auto job = decodes.pop()) {
+        try {
+          writer.put(job->seq, deserialize_response_to_string(*job->sch, *job->fn, job->resp));
+        } catch (const std::runtime_error& e) {
+          writer.put(job->seq, error_line(e));
+        }
+      }
+    });
+  }
+
+  OutputBuffer out;
+  writer.drain(out);
+  threads.clear();
+  out.append("Goodbye!\n");
+  out.flush(std::cout);
+}
+} // namespace ct
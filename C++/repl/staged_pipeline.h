@@ -0,0 +1,13 @@
+#pragma once
+#include "repl.h"
+
+namespace ct {
+
+// многопоточный bulk-режим для no-tty. строки проходят через стадии, соединённые очередями BoundedQueue:
+// читатель -> пул парсинга и сериализации (opts.workers потоков) -> отправители (opts.inflight потоков, у каждого свой
+// rpc::Client) -> пул разбора ответов (opts.workers потоков) -> упорядоченный писатель.
+// версию схемы строка получает на стадии парсинга и несёт её shared_ptr до разбора ответа, так что перезагрузка схемы
+// не меняет её посреди запроса. ответы печатаются в порядке входных строк. отправители шлют через layers
+void run_no_tty_staged(const SchemaHandle& sch, const Options& opts, SendLayers layers = {});
+
+} // namespace ct
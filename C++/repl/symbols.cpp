@@ -0,0 +1,71 @@
+#include "symbols.h"
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace ct {
+namespace {
+
+// имена лежат в deque: push_back не двигает уже добавленные строки, поэтому string_view на них остаются валидными.
+// id -> имя - массив блоков по CHUNK записей; блок публикуется атомарно и потом не перемещается, так что name()
+// может читать без мьютекса, пока кто-то добавляет новые имена
+struct Table {
+  static constexpr std::size_t CHUNK = 4096;
+  static constexpr std::size_t MAX_CHUNKS = 1 << 16;
+
+  std::mutex m;
+  std::deque<std::string> storage;
+  std::unordered_map<std::string_view, Symbol> ids;
+  std::array<std::atomic<std::string_view*>, MAX_CHUNKS> chunks{};
+  std::deque<std::unique_ptr<std::string_view[]>> owned;
+};
+
+Table& table() {
+  static Table t;
+  return t;
+}
+} // namespace
+
+Symbol Symbols::intern(std::string_view name) {
+  Table& t = table();
+  std::lock_guard lock(t.m);
+  auto it = t.ids.find(name);
+  if (it != t.ids.end()) {
+    return it->second;
+  }
+  std::size_t id = t.storage.size();
+  if (id / Table::CHUNK >= Table::MAX_CHUNKS) {
+    throw std::length_error("too many symbols");
+  }
+  std::string_view stored = t.storage.emplace_back(name);
+  std::string_view* chunk = t.chunks[id / Table::CHUNK].load(std::memory_order_relaxed);
+  if (!chunk) {
+    chunk = t.owned.emplace_back(std::make_unique<std::string_view[]>(Table::CHUNK)).get();
+    t.chunks[id / Table::CHUNK].store(chunk, std::memory_order_release);
+  }
+  chunk[id % Table::CHUNK] = stored;
+  t.ids.emplace(stored, static_cast<Symbol>(id));
+  return static_cast<Symbol>(id);
+}
+
+std::optional<Symbol> Symbols::find(std::string_view name) {
+  Table& t = table();
+  std::lock_guard lock(t.m);
+  auto it = t.ids.find(name);
+  if (it == t.ids.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+// id получен из intern(), значит его запись уже видна вызывающему потоку
+std::string_view Symbols::name(Symbol id) {
+  return table().chunks[id / Table::CHUNK].load(std::memory_order_acquire)[id % Table::CHUNK];
+}
+} // namespace ct
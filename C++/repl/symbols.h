@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace ct {
+
+// id имени в таблице символов
+using Symbol = uint32_t;
+
+// общая на процесс таблица имён из схем: имя -> Symbol и обратно. id не переиспользуются и имена живут до конца
+// процесса, поэтому Type может хранить только число, а схемы, разобранные в разных потоках или перезагруженные,
+// получают одинаковые id для одинаковых имён.
+// name() читает без блокировок, intern() и find() берут мьютекс - они нужны только при загрузке схемы
+class Symbols {
+public:
+  static Symbol intern(std::string_view name);
+
+  // id уже известного имени; новое имя не добавляет
+  static std::optional<Symbol> find(std::string_view name);
+
+  static std::string_view name(Symbol id);
+};
+
+} // namespace ct
@@ -0,0 +1,92 @@
+#include "value_gen.h"
+
+#include "endian.h"
+
+#include <string_view>
+
+namespace ct {
+namespace {
+
+constexpr std::string_view ALPHABET = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+std::size_t string_length(std::mt19937_64& rng, const GenOptions& opts) {
+  if (opts.max_string <= opts.min_string) {
+    return opts.min_string;
+  }
+  if (opts.dist == LengthDist::Exponential) {
+    double mean = opts.mean_string == 0 ? 1 : static_cast<double>(opts.mean_string);
+    double tail = std::exponential_distribution<double>(1 / mean)(rng);
+    double len = static_cast<double>(opts.min_string) + tail;
+    return len >= static_cast<double>(opts.max_string) ? opts.max_string : static_cast<std::size_t>(len);
+  }
+  return std::uniform_int_distribution<std::size_t>(opts.min_string, opts.max_string)(rng);
+}
+
+void fill_string(std::mt19937_64& rng, std::size_t len, char* dst) {
+  for (std::size_t k = 0; k < len; k++) {
+    dst[k] = ALPHABET[rng() % ALPHABET.size()];
+  }
+}
+
+// значение операции op; у структуры поля заполняются по её Struct::plan
+Value generate_value(const PlanOp& op, std::mt19937_64& rng, const GenOptions& opts, std::pmr::memory_resource* mr) {
+  if (op.kind == PlanOpKind::Builtin) {
+    switch (op.builtin) {
+    case Builtin::String: {
+      std::pmr::string s(string_length(rng, opts), '\0', mr);
+      fill_string(rng, s.size(), s.data());
+      return Value{std::move(s)};
+    }
+    case Builtin::Int32:
+      return Value{Int{static_cast<int32_t>(rng())}};
+    case Builtin::Int64:
+      return Value{Int{static_cast<int64_t>(rng())}};
+    case Builtin::Uint32:
+      return Value{Int{static_cast<uint32_t>(rng())}};
+    case Builtin::Uint64:
+      return Value{UInt{rng()}};
+    }
+  }
+  StructValue sv{std::pmr::string(op.st->name, mr), op.st, std::pmr::vector<Value>(op.st->fields.size(), mr)};
+  for (auto& field : op.st->plan) {
+    sv.fields[field.field] = generate_value(field, rng, opts, mr);
+  }
+  return Value{std::move(sv)};
+}
+} // namespace
+
+void generate_wire(
+    const std::vector<PlanOp>& plan,
+    std::mt19937_64& rng,
+    const GenOptions& opts,
+    std::vector<std::byte>& out
+) {
+  // у структур на проводе нет своих байтов - только поля подряд
+  for (auto& op : plan) {
+    if (op.kind == PlanOpKind::Struct) {
+      generate_wire(op.st->plan, rng, opts, out);
+      continue;
+    }
+    if (op.builtin == Builtin::String) {
+      std::size_t len = string_length(rng, opts);
+      put_be<uint32_t>(out, static_cast<uint32_t>(len));
+      std::size_t pos = out.size();
+      out.resize(pos + len);
+      fill_string(rng, len, reinterpret_cast<char*>(out.data() + pos));
+    } else if (op.builtin == Builtin::Int32 || op.builtin == Builtin::Uint32) {
+      put_be<uint32_t>(out, static_cast<uint32_t>(rng()));
+    } else {
+      put_be<uint64_t>(out, rng());
+    }
+  }
+}
+
+Call generate_call(const Function& fn, std::mt19937_64& rng, const GenOptions& opts, std::pmr::memory_resource* mr) {
+  Call call{std::pmr::string(fn.name, mr), std::pmr::vector<NamedArg>(mr)};
+  call.args.reserve(fn.args.size());
+  for (auto& op : fn.plan.args) {
+    call.args.push_back({std::pmr::string(*op.name, mr), generate_value(op, rng, opts, mr)});
+  }
+  return call;
+}
+} // namespace ct
@@ -0,0 +1,46 @@
+#pragma once
+#include "my_types.h"
+#include "request_classes.h"
+
+#include <cstddef>
+#include <memory_resource>
+#include <random>
+#include <vector>
+
+namespace ct {
+
+enum class LengthDist {
+  // равномерно в [min_string, max_string]
+  Uniform,
+  // min_string + экспоненциальный хвост со средним mean_string, обрезанный по max_string: много коротких строк и
+  // редкие длинные
+  Exponential
+};
+
+// настройки случайных значений. символы строк - буквы и цифры
+struct GenOptions {
+  LengthDist dist = LengthDist::Uniform;
+  std::size_t min_string = 0;
+  std::size_t max_string = 16;
+  std::size_t mean_string = 8;
+};
+
+// дописывает в out случайное значение, закодированное по плану (например, Function::plan.ret) ровно так, как его
+// ждёт десериализатор. нужно стендам вместо настоящего сервера
+void generate_wire(
+    const std::vector<PlanOp>& plan,
+    std::mt19937_64& rng,
+    const GenOptions& opts,
+    std::vector<std::byte>& out
+);
+
+// случайный корректный вызов fn: все аргументы заданы, вложенные структуры заполнены целиком, числа в пределах своих
+// типов. идёт по плану аргументов (Function::plan.args), так что схема отдельно не нужна. память берётся из mr
+Call generate_call(
+    const Function& fn,
+    std::mt19937_64& rng,
+    const GenOptions& opts,
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource()
+);
+
+} // namespace ct